@@ -0,0 +1,27 @@
+#!/bin/bash
+# Builds the tools and measures parser/synthesis/render stages over a
+# synthetic corpus. Scale up or down by editing the spec list below
+# (tracks, notes per second, duration in seconds).
+set -e
+cd "$(dirname "$0")"
+
+./make.sh
+(cd ../midisynth-basic/midisynth-c && ./make.sh)
+(cd ../mivi-c && ./make.sh) || echo "mivi not built (SDL2 missing?)"
+
+mkdir -p corpus
+
+# approx. 1k / 10k / 100k / 1M notes
+for spec in "4 100 10" "8 500 20" "16 2000 50" "32 10000 100"; do
+    set -- $spec
+    out="corpus/gen-${1}t-${2}nps-${3}s.mid"
+    [ -f "$out" ] || ./genmidi "$out" "$1" "$2" "$3"
+    echo "== $out =="
+    /usr/bin/time -f "BENCH midisynth     %e s total (%M kB peak RSS)" \
+        ../midisynth-basic/midisynth-c/midisynth "$out" /tmp/bench-out.wav \
+        > /dev/null
+    if [ -x ../mivi-c/mivi ]; then
+        ../mivi-c/mivi "$out" -bench | grep '^BENCH'
+    fi
+done
+rm -f /tmp/bench-out.wav
@@ -0,0 +1,195 @@
+/* ==================================================================
+ * Genmidi -- synthetic MIDI generator for benchmarking
+ * ==================================================================
+ * Produces standard MIDI files of configurable track count, note
+ * density and duration, so parser/synthesizer scaling can be measured
+ * reproducibly from 1k to 10M notes. Written in C90 with no
+ * dependencies, same as midisynth.
+ *
+ * Compile:
+ *    gcc genmidi.c -o genmidi
+ *
+ * Usage:
+ *    ./genmidi <out.mid> <tracks> <notes_per_second> <duration_s> [seed]
+ * ================================================================== */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define DIVISION 480
+#define TEMPO_MICROS 500000 /* 120 BPM -> 960 ticks per second */
+#define TICKS_PER_SECOND 960
+
+/* One note-on or note-off, before delta encoding */
+typedef struct {
+    uint32_t tick;
+    uint8_t status;
+    uint8_t key;
+    uint8_t velocity;
+} RawEvent;
+
+void write_be16(FILE *f, uint16_t v) {
+    uint8_t b[2];
+    b[0] = (uint8_t)(v >> 8);
+    b[1] = (uint8_t)(v & 0xFF);
+    fwrite(b, 1, 2, f);
+}
+
+void write_be32(FILE *f, uint32_t v) {
+    uint8_t b[4];
+    b[0] = (uint8_t)(v >> 24);
+    b[1] = (uint8_t)((v >> 16) & 0xFF);
+    b[2] = (uint8_t)((v >> 8) & 0xFF);
+    b[3] = (uint8_t)(v & 0xFF);
+    fwrite(b, 1, 4, f);
+}
+
+/* Variable-length quantity, most significant groups first */
+void write_varlen(FILE *f, uint32_t v) {
+    uint8_t out[5];
+    int n = 0;
+    do {
+        out[n++] = (uint8_t)(v & 0x7F);
+        v >>= 7;
+    } while (v > 0);
+    while (n > 1) fputc(out[--n] | 0x80, f);
+    fputc(out[0], f);
+}
+
+int compare_raw_events(const void *a, const void *b) {
+    const RawEvent *ea = (const RawEvent *)a;
+    const RawEvent *eb = (const RawEvent *)b;
+    if (ea->tick < eb->tick) return -1;
+    if (ea->tick > eb->tick) return 1;
+    /* Note-off before note-on at the same tick, avoids zero-length
+     * retriggers in the consumer */
+    return (int)(ea->status >> 4) - (int)(eb->status >> 4);
+}
+
+/* Pseudo random in [lo, hi] */
+int rnd_range(int lo, int hi) {
+    return lo + rand() % (hi - lo + 1);
+}
+
+int main(int argc, char **argv) {
+    const char *filename;
+    int num_tracks;
+    double density;
+    double duration;
+    long notes_per_track;
+    FILE *f;
+    int t;
+    long total_notes = 0;
+
+    if (argc < 5) {
+        printf("Usage: %s <out.mid> <tracks> <notes_per_second> <duration_s> [seed]\n",
+            argv[0]);
+        return 1;
+    }
+    filename = argv[1];
+    num_tracks = atoi(argv[2]);
+    density = atof(argv[3]);
+    duration = atof(argv[4]);
+    srand(argc > 5 ? (unsigned)atol(argv[5]) : 12345u);
+
+    if (num_tracks < 1 || num_tracks > 128 || density <= 0 || duration <= 0) {
+        fprintf(stderr, "Error: Implausible parameters.\n");
+        return 1;
+    }
+    notes_per_track = (long)(density * duration) / num_tracks;
+    if (notes_per_track < 1) notes_per_track = 1;
+
+    f = fopen(filename, "wb");
+    if (!f) {
+        fprintf(stderr, "Error: Could not open output file.\n");
+        return 1;
+    }
+
+    /* Header: format 1, tempo track + note tracks */
+    fwrite("MThd", 1, 4, f);
+    write_be32(f, 6);
+    write_be16(f, 1);
+    write_be16(f, (uint16_t)(num_tracks + 1));
+    write_be16(f, DIVISION);
+
+    /* Tempo track */
+    fwrite("MTrk", 1, 4, f);
+    write_be32(f, 11);
+    write_varlen(f, 0);
+    fputc(0xFF, f); fputc(0x51, f); fputc(0x03, f);
+    fputc((TEMPO_MICROS >> 16) & 0xFF, f);
+    fputc((TEMPO_MICROS >> 8) & 0xFF, f);
+    fputc(TEMPO_MICROS & 0xFF, f);
+    write_varlen(f, 0);
+    fputc(0xFF, f); fputc(0x2F, f); fputc(0x00, f);
+
+    for (t = 0; t < num_tracks; t++) {
+        /* Channel 9 stays in the mix so drum handling is benchmarked too */
+        int channel = t % 16;
+        RawEvent *evts;
+        long n;
+        long count = 0;
+        long len_pos, end_pos;
+        uint32_t last_tick = 0;
+        uint32_t max_tick = (uint32_t)(duration * TICKS_PER_SECOND);
+
+        evts = malloc((size_t)notes_per_track * 2 * sizeof(RawEvent));
+        if (!evts) {
+            fprintf(stderr, "Error: Out of memory.\n");
+            return 1;
+        }
+
+        for (n = 0; n < notes_per_track; n++) {
+            uint32_t start = (uint32_t)((double)rand() / RAND_MAX * max_tick);
+            uint32_t len = (uint32_t)rnd_range(TICKS_PER_SECOND / 10,
+                TICKS_PER_SECOND * 2);
+            uint8_t key = (uint8_t)rnd_range(21, 108);
+            uint8_t vel = (uint8_t)rnd_range(30, 127);
+
+            if (start + len > max_tick) len = max_tick - start;
+            if (len == 0) len = 1;
+
+            evts[count].tick = start;
+            evts[count].status = (uint8_t)(0x90 | channel);
+            evts[count].key = key;
+            evts[count].velocity = vel;
+            count++;
+            evts[count].tick = start + len;
+            evts[count].status = (uint8_t)(0x80 | channel);
+            evts[count].key = key;
+            evts[count].velocity = 0;
+            count++;
+        }
+        qsort(evts, (size_t)count, sizeof(RawEvent), compare_raw_events);
+
+        fwrite("MTrk", 1, 4, f);
+        len_pos = ftell(f);
+        write_be32(f, 0); /* patched below */
+
+        for (n = 0; n < count; n++) {
+            write_varlen(f, evts[n].tick - last_tick);
+            last_tick = evts[n].tick;
+            fputc(evts[n].status, f);
+            fputc(evts[n].key, f);
+            fputc(evts[n].velocity, f);
+        }
+        write_varlen(f, 0);
+        fputc(0xFF, f); fputc(0x2F, f); fputc(0x00, f);
+
+        /* Patch the track length */
+        end_pos = ftell(f);
+        fseek(f, len_pos, SEEK_SET);
+        write_be32(f, (uint32_t)(end_pos - len_pos - 4));
+        fseek(f, end_pos, SEEK_SET);
+
+        total_notes += notes_per_track;
+        free(evts);
+    }
+
+    fclose(f);
+    printf("Wrote %s: %d tracks, %ld notes, %.1f s\n",
+        filename, num_tracks, total_notes, duration);
+    return 0;
+}
@@ -0,0 +1,2 @@
+#!/bin/bash
+gcc genmidi.c -o genmidi -std=c90 -pedantic -Wall -Wextra -O2
@@ -0,0 +1,3 @@
+#!/bin/bash
+gcc -c midicore.c -o midicore.o -pedantic -Wall -Wextra -O3
+ar rcs libmidicore.a midicore.o
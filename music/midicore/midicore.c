@@ -0,0 +1,633 @@
+/* ==================================================================
+ * libmidicore -- implementation
+ * ==================================================================
+ * See midicore.h for the API. The code is the union of the two
+ * program-local parsers: mivi's mmap loader (with a plain-read
+ * fallback for Windows), midisynth's context object and its C90
+ * discipline. Comments that explain a technique live here now and
+ * nowhere else.
+ * ================================================================== */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#endif
+
+#include "midicore.h"
+
+/* ==================================================================
+   RAW BYTES (MEMORY-MAPPED)
+   ================================================================== */
+
+/*
+ * The whole file is mapped (POSIX) or read in one piece and parsed by
+ * walking a cursor over the raw bytes. The original parsers went
+ * through stdio one or two bytes at a time plus an fseek() for every
+ * skipped field, which on black-MIDI files means millions of libc
+ * calls for a few megabytes of data.
+ */
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+    size_t pos;
+    int mapped; /* munmap vs. free on unload */
+} McData;
+
+/* Aborts if fewer than n bytes are left */
+static void need_bytes(const McData *m, size_t n) {
+    if (m->pos > m->size || m->size - m->pos < n) {
+        fprintf(stderr, "Error: Unexpected end of file or read error.\n");
+        exit(1);
+    }
+}
+
+static uint8_t read_u8(McData *m) {
+    need_bytes(m, 1);
+    return m->data[m->pos++];
+}
+
+static uint16_t read_be16(McData *m) {
+    need_bytes(m, 2);
+    m->pos += 2;
+    return (uint16_t)((m->data[m->pos - 2] << 8) | m->data[m->pos - 1]);
+}
+
+static uint32_t read_be32(McData *m) {
+    const uint8_t *b;
+    need_bytes(m, 4);
+    b = m->data + m->pos;
+    m->pos += 4;
+    return ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) |
+        ((uint32_t)b[2] << 8) | b[3];
+}
+
+static uint32_t read_varlen(McData *m) {
+    uint32_t value = 0;
+    uint8_t c;
+    do {
+        c = read_u8(m);
+        value = (value << 7) | (c & 0x7F);
+    } while (c & 0x80);
+    return value;
+}
+
+/* Bounds-checked cursor jump, replaces the fseek calls */
+static void skip_bytes(McData *m, size_t n) {
+    need_bytes(m, n);
+    m->pos += n;
+}
+
+static void load_midi_data(const char *filename, McData *m) {
+    FILE *f;
+    long len;
+    uint8_t *data;
+
+#ifndef _WIN32
+    int fd = open(filename, O_RDONLY);
+    if (fd >= 0) {
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void *map = mmap(NULL, (size_t)st.st_size, PROT_READ,
+                MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (map != MAP_FAILED) {
+                m->data = map;
+                m->size = (size_t)st.st_size;
+                m->pos = 0;
+                m->mapped = 1;
+                return;
+            }
+        } else {
+            close(fd);
+        }
+    }
+#endif
+    /* Fallback (Windows / mmap failed): read the whole file */
+    f = fopen(filename, "rb");
+    if (!f) {
+        fprintf(stderr, "Error: Could not open file: %s\n", filename);
+        exit(1);
+    }
+    fseek(f, 0, SEEK_END);
+    len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    data = malloc(len > 0 ? (size_t)len : 1);
+    if (!data || len < 0 ||
+        fread(data, 1, (size_t)len, f) != (size_t)len) {
+        fprintf(stderr, "Error: Could not read file: %s\n", filename);
+        exit(1);
+    }
+    fclose(f);
+    m->data = data;
+    m->size = (size_t)len;
+    m->pos = 0;
+    m->mapped = 0;
+}
+
+static void unload_midi_data(McData *m) {
+#ifndef _WIN32
+    if (m->mapped) {
+        munmap((void *)m->data, m->size);
+        return;
+    }
+#endif
+    free((void *)m->data);
+}
+
+/* Clock for the merge_seconds statistic; wall time where available */
+static double mc_now(void) {
+#ifdef _WIN32
+    return (double)clock() / (double)CLOCKS_PER_SEC;
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double)tv.tv_sec + (double)tv.tv_usec / 1000000.0;
+#endif
+}
+
+/* ==================================================================
+   EVENT ARENA
+   ================================================================== */
+
+void mc_song_init(McSong *s) {
+    memset(s, 0, sizeof(*s));
+}
+
+void mc_song_free(McSong *s) {
+    free(s->events);
+    free(s->tempo_map);
+    mc_song_init(s);
+}
+
+static void add_event(McSong *s, McEvent e) {
+    if (s->event_count >= s->event_capacity) {
+        size_t new_capacity =
+            (s->event_capacity == 0) ? 1024 : s->event_capacity * 2;
+        McEvent *temp = realloc(s->events, new_capacity * sizeof(McEvent));
+        if (temp == NULL) {
+            fprintf(stderr, "Error: Out of memory reallocating events.\n");
+            free(s->events);
+            exit(1);
+        }
+        s->events = temp;
+        s->event_capacity = new_capacity;
+    }
+    s->events[s->event_count++] = e;
+}
+
+/*
+ * Reserves the events array in one go from the file size. Every event
+ * we store consumes at least 3 bytes on disk (delta time plus two data
+ * bytes, even with running status), so file_size / 3 is a hard upper
+ * bound on the event count and the doubling in add_event never fires
+ * mid-parse. If the reservation fails, add_event still grows the array
+ * the old way.
+ */
+static void reserve_events(McSong *s, size_t file_size) {
+    size_t estimate = file_size / 3 + 16;
+    McEvent *temp;
+    if (s->event_capacity >= estimate) return;
+    temp = realloc(s->events, estimate * sizeof(McEvent));
+    if (temp != NULL) {
+        s->events = temp;
+        s->event_capacity = estimate;
+    }
+}
+
+/* Fallback comparison for qsort (by ticks) */
+static int compare_events(const void *a, const void *b) {
+    const McEvent *ea = (const McEvent *)a;
+    const McEvent *eb = (const McEvent *)b;
+    if (ea->abs_tick < eb->abs_tick) return -1;
+    if (ea->abs_tick > eb->abs_tick) return 1;
+    return 0;
+}
+
+/* ==================================================================
+   K-WAY TRACK MERGE
+   ================================================================== */
+
+/*
+ * Each track is appended to the events array in ascending abs_tick
+ * order, so after parsing the array is a union of k sorted runs. A
+ * k-way merge over those runs costs O(n log k) instead of the
+ * O(n log n) of a global qsort, and it is stable: ties keep track
+ * order, within a track the original order.
+ *
+ * The merge uses a small binary heap of run indices keyed by the tick
+ * of each run's next event (ties broken by run index for stability).
+ */
+
+/* Is run a's next event due before run b's? */
+static int run_less(const McEvent *evts, int a, int b, const size_t *pos) {
+    uint32_t ta = evts[pos[a]].abs_tick;
+    uint32_t tb = evts[pos[b]].abs_tick;
+    if (ta != tb) return ta < tb;
+    return a < b;
+}
+
+static void merge_heap_sift_down(
+    const McEvent *evts, int *heap, int heap_size, const size_t *pos
+) {
+    int i = 0;
+    for (;;) {
+        int smallest = i;
+        int l = 2 * i + 1;
+        int r = 2 * i + 2;
+        int tmp;
+        if (l < heap_size && run_less(evts, heap[l], heap[smallest], pos))
+            smallest = l;
+        if (r < heap_size && run_less(evts, heap[r], heap[smallest], pos))
+            smallest = r;
+        if (smallest == i) break;
+        tmp = heap[i]; heap[i] = heap[smallest]; heap[smallest] = tmp;
+        i = smallest;
+    }
+}
+
+/* offsets[r]..offsets[r+1] delimits run r in the events array */
+static void merge_track_runs(McSong *s, const size_t *offsets, int num_runs) {
+    McEvent *merged;
+    size_t *pos;
+    int *heap;
+    int heap_size = 0;
+    size_t out = 0;
+    int r;
+
+    if (num_runs <= 1 || s->event_count == 0) return;
+
+    merged = malloc(s->event_count * sizeof(McEvent));
+    pos = malloc((size_t)num_runs * sizeof(size_t));
+    heap = malloc((size_t)num_runs * sizeof(int));
+    if (merged == NULL || pos == NULL || heap == NULL) {
+        /* Not enough memory for the scratch space: sort in place */
+        free(merged); free(pos); free(heap);
+        qsort(s->events, s->event_count, sizeof(McEvent), compare_events);
+        return;
+    }
+
+    /* Build the heap from all non-empty runs */
+    for (r = 0; r < num_runs; r++) {
+        pos[r] = offsets[r];
+        if (offsets[r] < offsets[r + 1]) {
+            int i = heap_size++;
+            heap[i] = r;
+            while (i > 0 &&
+                   run_less(s->events, heap[i], heap[(i - 1) / 2], pos)) {
+                int tmp = heap[i];
+                heap[i] = heap[(i - 1) / 2];
+                heap[(i - 1) / 2] = tmp;
+                i = (i - 1) / 2;
+            }
+        }
+    }
+
+    while (heap_size > 0) {
+        r = heap[0];
+        merged[out++] = s->events[pos[r]++];
+        if (pos[r] < offsets[r + 1]) {
+            /* Replace the top with the run's next event */
+            merge_heap_sift_down(s->events, heap, heap_size, pos);
+        } else {
+            heap[0] = heap[--heap_size];
+            merge_heap_sift_down(s->events, heap, heap_size, pos);
+        }
+    }
+
+    free(s->events);
+    s->events = merged;
+    s->event_capacity = s->event_count;
+    free(pos);
+    free(heap);
+}
+
+/* ==================================================================
+   PARSER
+   ================================================================== */
+
+void mc_song_parse(McSong *s, const char *filename) {
+    McData m;
+    uint16_t num_tracks;
+    size_t *track_offsets;
+    double merge_start;
+    int t;
+
+    load_midi_data(filename, &m);
+
+    /* One up-front reservation instead of realloc doubling mid-parse */
+    reserve_events(s, m.size);
+
+    /* Header Chunk */
+    need_bytes(&m, 4);
+    if (memcmp(m.data, "MThd", 4) != 0) {
+        fprintf(stderr, "Error: Not a valid MIDI file.\n");
+        exit(1);
+    }
+    m.pos += 4;
+
+    read_be32(&m); /* Header length (skip) */
+    read_be16(&m); /* Format (skip) */
+    num_tracks = read_be16(&m);
+    s->division = read_be16(&m);
+    s->num_tracks = (int)num_tracks;
+
+    if (s->division & 0x8000) {
+        fprintf(stderr, "Error: SMPTE timecode is not supported.\n");
+        exit(1);
+    }
+
+    track_offsets = malloc(((size_t)num_tracks + 1) * sizeof(size_t));
+    if (track_offsets == NULL) {
+        fprintf(stderr, "Error: Out of memory.\n");
+        exit(1);
+    }
+
+    /* Read Tracks */
+    for (t = 0; t < num_tracks; t++) {
+        uint32_t track_len;
+        size_t track_end;
+        uint32_t abs_tick = 0;
+        uint8_t running_status = 0;
+
+        /* Run boundary for the merge below */
+        track_offsets[t] = s->event_count;
+
+        need_bytes(&m, 4);
+        while (memcmp(m.data + m.pos, "MTrk", 4) != 0) {
+            /* Skip unknown chunks */
+            uint32_t skip;
+            m.pos += 4;
+            skip = read_be32(&m);
+            skip_bytes(&m, skip);
+            need_bytes(&m, 4);
+        }
+        m.pos += 4;
+
+        track_len = read_be32(&m);
+        need_bytes(&m, track_len);
+        track_end = m.pos + track_len;
+
+        while (m.pos < track_end) {
+            uint32_t delta = read_varlen(&m);
+            uint8_t status;
+            uint8_t byte;
+
+            abs_tick += delta;
+            byte = read_u8(&m);
+
+            if (byte >= 0x80) {
+                status = byte;
+                running_status = status;
+            } else {
+                /* A data byte without any running status would be
+                 * misparsed as a message; skip it */
+                if (running_status == 0) continue;
+                status = running_status;
+                m.pos--; /* Rewind 1 byte */
+            }
+
+            /* Process Events */
+            if (status == 0xFF) { /* Meta Event */
+                uint8_t type = read_u8(&m);
+                uint32_t len = read_varlen(&m);
+
+                if (type == 0x51 && len == 3) { /* Set Tempo */
+                    int micros;
+                    McEvent e;
+
+                    need_bytes(&m, 3);
+                    micros = ((int)m.data[m.pos] << 16) |
+                        ((int)m.data[m.pos + 1] << 8) | m.data[m.pos + 2];
+                    m.pos += 3;
+
+                    e.abs_tick = abs_tick;
+                    e.type = MC_EVENT_SET_TEMPO;
+                    e.channel = 0;
+                    e.note = 0;
+                    e.velocity = 0;
+                    e.tempo_micros = micros;
+                    add_event(s, e);
+                } else if (type == 0x2F) {
+                    /* End of Track -> End loop for this track */
+                    m.pos = track_end;
+                    break;
+                } else {
+                    skip_bytes(&m, len); /* Skip meta data */
+                }
+            } else if (status == 0xF0 || status == 0xF7) { /* SysEx */
+                uint32_t len = read_varlen(&m);
+                skip_bytes(&m, len);
+            } else if ((status & 0xF0) == 0x90) { /* Note On */
+                uint8_t note, vel;
+                McEvent e;
+                note = read_u8(&m);
+                vel = read_u8(&m);
+
+                e.abs_tick = abs_tick;
+                e.type = (vel > 0 ? MC_EVENT_NOTE_ON : MC_EVENT_NOTE_OFF);
+                e.channel = status & 0x0F;
+                e.note = note;
+                e.velocity = vel;
+                e.tempo_micros = 0;
+                add_event(s, e);
+            } else if ((status & 0xF0) == 0x80) { /* Note Off */
+                uint8_t note, vel;
+                McEvent e;
+                note = read_u8(&m);
+                vel = read_u8(&m);
+
+                e.abs_tick = abs_tick;
+                e.type = MC_EVENT_NOTE_OFF;
+                e.channel = status & 0x0F;
+                e.note = note;
+                e.velocity = vel;
+                e.tempo_micros = 0;
+                add_event(s, e);
+            } else {
+                /* Other Channel Messages (Control Change etc.) */
+                uint8_t cmd = status & 0xF0;
+                if (cmd == 0xC0 || cmd == 0xD0) {
+                    skip_bytes(&m, 1);
+                } else {
+                    skip_bytes(&m, 2);
+                }
+            }
+        }
+    }
+    unload_midi_data(&m);
+
+    /* Merge the per-track runs into one time-ordered stream */
+    merge_start = mc_now();
+    track_offsets[num_tracks] = s->event_count;
+    merge_track_runs(s, track_offsets, num_tracks);
+    s->merge_seconds = mc_now() - merge_start;
+    free(track_offsets);
+}
+
+/* ==================================================================
+   TEMPO MAP
+   ================================================================== */
+
+/*
+ * A prefix table over the MC_EVENT_SET_TEMPO events. Each entry
+ * records the tick a tempo takes effect, the cumulative seconds up to
+ * that tick and the seconds per tick from there on, so converting in
+ * either direction is a binary search plus one multiply instead of a
+ * linear replay of the event stream. This is the groundwork for
+ * random seeks and windowed synthesis.
+ */
+void mc_build_tempo_map(McSong *s) {
+    size_t cap = 16;
+    size_t i;
+    McTempoSpan *map;
+
+    map = malloc(cap * sizeof(McTempoSpan));
+    if (!map) {
+        fprintf(stderr, "Error: Out of memory for tempo map.\n");
+        exit(1);
+    }
+    map[0].tick = 0;
+    map[0].seconds = 0.0;
+    map[0].seconds_per_tick = (500000.0 / 1000000.0) / (double)s->division;
+    s->tempo_map_count = 1;
+
+    for (i = 0; i < s->event_count; i++) {
+        McTempoSpan *last;
+        double spt, secs;
+
+        if (s->events[i].type != MC_EVENT_SET_TEMPO) continue;
+        last = &map[s->tempo_map_count - 1];
+        spt = ((double)s->events[i].tempo_micros / 1000000.0) /
+            (double)s->division;
+
+        /* A tempo change on the same tick just replaces the entry */
+        if (s->events[i].abs_tick == last->tick) {
+            last->seconds_per_tick = spt;
+            continue;
+        }
+        secs = last->seconds +
+            (double)(s->events[i].abs_tick - last->tick) *
+            last->seconds_per_tick;
+        if (s->tempo_map_count == cap) {
+            McTempoSpan *temp;
+            cap *= 2;
+            temp = realloc(map, cap * sizeof(McTempoSpan));
+            if (!temp) {
+                fprintf(stderr, "Error: Out of memory for tempo map.\n");
+                exit(1);
+            }
+            map = temp;
+        }
+        map[s->tempo_map_count].tick = s->events[i].abs_tick;
+        map[s->tempo_map_count].seconds = secs;
+        map[s->tempo_map_count].seconds_per_tick = spt;
+        s->tempo_map_count++;
+    }
+    s->tempo_map = map;
+}
+
+/* Largest entry with tick <= target, then linear within the segment */
+double mc_tick_to_seconds(const McSong *s, uint32_t tick) {
+    const McTempoSpan *map = s->tempo_map;
+    size_t lo = 0, hi = s->tempo_map_count;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (map[mid].tick <= tick) lo = mid; else hi = mid;
+    }
+    return map[lo].seconds +
+        (double)(tick - map[lo].tick) * map[lo].seconds_per_tick;
+}
+
+uint32_t mc_seconds_to_tick(const McSong *s, double seconds) {
+    const McTempoSpan *map = s->tempo_map;
+    size_t lo = 0, hi = s->tempo_map_count;
+    double ticks;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (map[mid].seconds <= seconds) lo = mid; else hi = mid;
+    }
+    ticks = (seconds - map[lo].seconds) / map[lo].seconds_per_tick;
+    if (ticks < 0) ticks = 0;
+    return map[lo].tick + (uint32_t)ticks;
+}
+
+/* ==================================================================
+   CONVERSION TO NOTES (Ticks -> Seconds)
+   ================================================================== */
+
+McNote *mc_convert_to_notes(
+    McSong *s,
+    size_t *out_note_count,
+    double *out_total_duration
+) {
+    McNote *notes;
+    size_t note_idx = 0;
+    size_t i;
+    int c, n;
+
+    double current_time = 0.0;
+
+    /* Temporary storage for active notes */
+    double active_notes[16][128];
+    int active_velocities[16][128];
+
+    notes = malloc(sizeof(McNote) *
+        (s->event_count > 0 ? s->event_count : 1)); /* Max possible count */
+    if (!notes) {
+        fprintf(stderr, "Error: Out of memory for notes.\n");
+        exit(1);
+    }
+
+    if (!s->tempo_map) mc_build_tempo_map(s);
+
+    for (c = 0; c < 16; c++)
+        for (n = 0; n < 128; n++)
+            active_notes[c][n] = -1.0;
+
+    for (i = 0; i < s->event_count; i++) {
+        McEvent e = s->events[i];
+
+        current_time = mc_tick_to_seconds(s, e.abs_tick);
+
+        if (e.type == MC_EVENT_NOTE_ON) {
+            /* If note is already on, finish it first (retrigger),
+             * then restart */
+            if (active_notes[e.channel][e.note] >= 0.0) {
+                McNote note_obj;
+                note_obj.start_time = active_notes[e.channel][e.note];
+                note_obj.duration = current_time - note_obj.start_time;
+                note_obj.midi_key = e.note;
+                note_obj.velocity = active_velocities[e.channel][e.note];
+                note_obj.channel = e.channel;
+                if (note_obj.duration > 0) notes[note_idx++] = note_obj;
+            }
+            active_notes[e.channel][e.note] = current_time;
+            active_velocities[e.channel][e.note] = e.velocity;
+        }
+        else if (e.type == MC_EVENT_NOTE_OFF) {
+            if (active_notes[e.channel][e.note] >= 0.0) {
+                McNote note_obj;
+                note_obj.start_time = active_notes[e.channel][e.note];
+                note_obj.duration = current_time - note_obj.start_time;
+                note_obj.midi_key = e.note;
+                note_obj.velocity = active_velocities[e.channel][e.note];
+                note_obj.channel = e.channel;
+                active_notes[e.channel][e.note] = -1.0;
+                if (note_obj.duration > 0) notes[note_idx++] = note_obj;
+            }
+        }
+    }
+
+    *out_note_count = note_idx;
+    /* Total duration + some reverb tail */
+    *out_total_duration = current_time + 1.0;
+    return notes;
+}
@@ -0,0 +1,92 @@
+/* ==================================================================
+ * libmidicore -- shared MIDI parsing core for midisynth and mivi
+ * ==================================================================
+ * Both programs used to carry their own copy of the parser, the track
+ * merge, the tempo map and the tick-to-seconds converter, built around
+ * mutable globals. This library holds the one tuned implementation
+ * (mmap'd byte-cursor parser, single arena reservation, stable k-way
+ * merge, binary-searchable tempo map) behind a context object, so
+ * several files can be processed concurrently and every optimization
+ * lands in both tools at once.
+ *
+ * Error convention matches the programs: malformed input and
+ * out-of-memory abort with a message on stderr and exit(1).
+ * ================================================================== */
+
+#ifndef MIDICORE_H
+#define MIDICORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    MC_EVENT_NOTE_ON,
+    MC_EVENT_NOTE_OFF,
+    MC_EVENT_SET_TEMPO,
+    MC_EVENT_OTHER
+} McEventType;
+
+typedef struct {
+    uint32_t abs_tick;
+    McEventType type;
+    int channel;
+    int note;
+    int velocity;
+    int tempo_micros;
+} McEvent;
+
+/* One tempo segment: the tick it takes effect, the cumulative seconds
+ * up to that tick and the seconds per tick from there on */
+typedef struct {
+    uint32_t tick;
+    double seconds;
+    double seconds_per_tick;
+} McTempoSpan;
+
+/* A finished note in seconds; consumers that need extra per-note data
+ * (mivi's channel color) derive it from these fields */
+typedef struct {
+    double start_time;
+    double duration;
+    int midi_key;
+    int velocity;
+    int channel;
+} McNote;
+
+/*
+ * All per-file state. Initialize with mc_song_init (or memset to 0),
+ * release with mc_song_free. After mc_song_parse the events are one
+ * time-ordered stream and division/num_tracks are filled in;
+ * merge_seconds reports the time spent in the k-way merge for the
+ * callers' profiling output.
+ */
+typedef struct {
+    McEvent *events;
+    size_t event_count;
+    size_t event_capacity;
+    McTempoSpan *tempo_map;
+    size_t tempo_map_count;
+    uint16_t division;
+    int num_tracks;
+    double merge_seconds;
+} McSong;
+
+void mc_song_init(McSong *s);
+void mc_song_free(McSong *s);
+
+/* Parses the file into s->events, merged into one stream sorted by
+ * tick (stable: ties keep track order) */
+void mc_song_parse(McSong *s, const char *filename);
+
+/* Built lazily by mc_convert_to_notes; callers that only need the
+ * time conversion can build it directly */
+void mc_build_tempo_map(McSong *s);
+double mc_tick_to_seconds(const McSong *s, uint32_t tick);
+uint32_t mc_seconds_to_tick(const McSong *s, double seconds);
+
+/* Pairs note-on/off events into a malloc'd McNote array (caller
+ * frees); *out_duration includes one second of release tail */
+McNote *mc_convert_to_notes(McSong *s, size_t *out_note_count,
+    double *out_total_duration);
+
+#endif /* MIDICORE_H */
@@ -1,3 +1,7 @@
 #!/bin/bash
-gcc midisynth.c -o midisynth -lm -std=c90 -pedantic -Wall -Wextra -O3
-
+(cd ../../midicore && ./make.sh)
+gcc midisynth.c -o midisynth -I../../midicore ../../midicore/libmidicore.a \
+    -lm -lpthread -std=c90 -pedantic -Wall -Wextra -O3
+# Optional GPU synthesis backend (needs OpenCL headers and an ICD):
+#   gcc midisynth.c -o midisynth -I../../midicore ../../midicore/libmidicore.a \
+#       -lm -lpthread -lOpenCL -DUSE_OPENCL -std=c90 -pedantic -Wall -Wextra -O3
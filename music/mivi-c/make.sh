@@ -1,3 +1,5 @@
 #!/bin/bash
-gcc mivi.c -o mivi -lm -lSDL2 -pedantic -Wall -Wextra -O3
+(cd ../midicore && ./make.sh)
+gcc mivi.c -o mivi -I../midicore ../midicore/libmidicore.a \
+    -lm -lSDL2 -pedantic -Wall -Wextra -O3
 
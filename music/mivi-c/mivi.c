@@ -9,11 +9,17 @@
 #include <math.h>
 #include <SDL2/SDL.h>
 
-/* Für popen/pclose auf POSIX-Systemen (Linux/Mac) */
+/* Für popen/pclose und mmap auf POSIX-Systemen (Linux/Mac) */
 #ifndef _WIN32
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #endif
 
+/* Gemeinsamer MIDI-Parser-Kern (siehe ../midicore) */
+#include "midicore.h"
+
 /* ==================================================================
    KONFIGURATION UND KONSTANTEN
    ================================================================== */
@@ -35,22 +41,6 @@
    DATENSTRUKTUREN
    ================================================================== */
 
-typedef enum {
-    EVENT_NOTE_ON,
-    EVENT_NOTE_OFF,
-    EVENT_SET_TEMPO,
-    EVENT_OTHER
-} EventType;
-
-typedef struct {
-    uint32_t abs_tick;
-    EventType type;
-    int channel;
-    int note;
-    int velocity;
-    int tempo_micros;
-} MidiEvent;
-
 typedef struct {
     double start_time;
     double duration;
@@ -60,13 +50,80 @@ typedef struct {
     SDL_Color color; /* Neu: Farbe direkt speichern */
 } Note;
 
+/* Transport-Kommandos vom Hauptthread an den Audio-Callback. Der
+ * play_cursor gehört damit allein dem Callback: Spulen und Pause
+ * laufen als Kommandos über einen lock-freien SPSC-Ring (Produzent:
+ * handle_input, Konsument: der Callback), statt dass zwei Threads
+ * konkurrierend auf dem Cursor schreiben (volatile ist nicht atomar,
+ * das gab hörbare Glitches beim Spulen unter Last). */
+#define TRANSPORT_RING_SIZE 16  /* Potenz von 2 */
+#define TRANSPORT_RING_MASK (TRANSPORT_RING_SIZE - 1)
+
+enum {
+    TC_SEEK = 0,  /* cursor = neue Abspielposition in Samples */
+    TC_PAUSE,     /* Stille ausgeben, Position halten */
+    TC_RESUME
+};
+
+typedef struct {
+    int type;
+    size_t cursor;
+} TransportCmd;
+
+/* Gleiche Disziplin wie LiveRing weiter unten: head schreibt nur der
+ * Produzent, tail nur der Konsument, Indizes laufen frei */
+typedef struct {
+    TransportCmd cmd[TRANSPORT_RING_SIZE];
+    SDL_atomic_t head;
+    SDL_atomic_t tail;
+} TransportRing;
+
 /* Globale Struktur für Audio-Wiedergabe */
 typedef struct {
     int16_t *pcm_buffer;    /* Der gesamte Song im RAM */
-    size_t total_samples;
-    volatile size_t play_cursor; /* Aktuelle Abspielposition */
+    volatile size_t total_samples; /* korrigiert der Timidity-Worker
+                                      am Pipe-Ende auf die echte Länge */
+    volatile size_t play_cursor; /* Aktuelle Abspielposition;
+                                    schreibt nur der Callback */
+    volatile size_t samples_ready; /* Wasserstand: bis hierhin ist der
+                                      Buffer fertig synthetisiert */
+    volatile size_t underruns;  /* Callback musste Stille einfüllen */
+    TransportRing transport;    /* Seek/Pause vom UI-Thread */
+    int cb_paused;              /* schreibt nur der Callback */
+    SDL_atomic_t pub_cursor;    /* vom Callback publizierte Position;
+                                   int reicht für gut 13 Stunden */
 } AudioContext;
 
+int transport_push(TransportRing *r, TransportCmd c) {
+    int head = SDL_AtomicGet(&r->head);
+    if (head - SDL_AtomicGet(&r->tail) >= TRANSPORT_RING_SIZE)
+        return 0; /* voll: bei 16 Plätzen tippt da niemand gegen an */
+    r->cmd[head & TRANSPORT_RING_MASK] = c;
+    SDL_AtomicSet(&r->head, head + 1);
+    return 1;
+}
+
+int transport_pop(TransportRing *r, TransportCmd *out) {
+    int tail = SDL_AtomicGet(&r->tail);
+    if (SDL_AtomicGet(&r->head) == tail) return 0;
+    *out = r->cmd[tail & TRANSPORT_RING_MASK];
+    SDL_AtomicSet(&r->tail, tail + 1);
+    return 1;
+}
+
+void transport_send(AudioContext *ctx, int type, size_t cursor) {
+    TransportCmd c;
+    c.type = type;
+    c.cursor = cursor;
+    transport_push(&ctx->transport, c);
+}
+
+/* Alle gesendeten Kommandos sind im Callback angekommen */
+int transport_idle(AudioContext *ctx) {
+    return SDL_AtomicGet(&ctx->transport.head) ==
+           SDL_AtomicGet(&ctx->transport.tail);
+}
+
 /* ==================================================================
    HELPER: FARBEN UND KEYBOARD
    ================================================================== */
@@ -89,227 +146,656 @@ int is_black_key(int midi) {
             note_in_octave == 10);
 }
 
-/* Berechnet X-Position und Breite für Tasten */
-void get_key_geometry(
-    int midi_note, float total_width,
-    float *x, float *w, int *is_black
-) {
+/* Tasten-Geometrie (X-Position, Breite, schwarz/weiß) für alle Noten.
+ * Früher wurde das pro Aufruf mit zwei Schleifen über alle Tasten neu
+ * berechnet -- und zwar einmal pro sichtbarer Note und Taste pro
+ * Frame. Jetzt wird die Tabelle einmal pro Fensterbreite gefüllt und
+ * jeder Zugriff ist nur noch ein Array-Index. */
+typedef struct {
+    float x;
+    float w;
+    int is_black;
+} KeyGeom;
+
+static KeyGeom key_geom[128];
+static float key_geom_width = -1.0f; /* Breite, für die die Tabelle gilt */
+
+void update_key_geometry(float total_width) {
+    if (total_width == key_geom_width) return;
+
     /* Zähle weiße Tasten im Bereich */
     int white_keys_total = 0;
-    int i;
-    for (i = MIN_MIDI; i <= MAX_MIDI; i++) {
+    for (int i = MIN_MIDI; i <= MAX_MIDI; i++) {
         if (!is_black_key(i)) white_keys_total++;
     }
 
     float wk_width = total_width / (float)white_keys_total;
     float bk_width = wk_width * 0.65f;
 
-    /* Zähle weiße Tasten bis zur aktuellen Note */
-    int current_wk_index = 0;
-    for (i = MIN_MIDI; i < midi_note; i++) {
-        if (!is_black_key(i)) current_wk_index++;
+    memset(key_geom, 0, sizeof(key_geom));
+
+    /* Ein Durchlauf: wk_index zählt die weißen Tasten unterhalb von i */
+    int wk_index = 0;
+    for (int i = MIN_MIDI; i <= MAX_MIDI; i++) {
+        float pos = wk_index * wk_width;
+        key_geom[i].is_black = is_black_key(i);
+        if (key_geom[i].is_black) {
+            key_geom[i].x = pos - (bk_width / 2.0f);
+            key_geom[i].w = bk_width;
+        } else {
+            key_geom[i].x = pos;
+            key_geom[i].w = wk_width;
+            wk_index++;
+        }
     }
+    key_geom_width = total_width;
+}
 
-    float pos = current_wk_index * wk_width;
+/* ==================================================================
+   MIDI-PARSER (libmidicore)
+   ================================================================== */
+/* Parser, Track-Merge, Tempo-Map und die Tick->Sekunden-Umrechnung
+ * liegen in der gemeinsamen libmidicore (../midicore) -- mivi und
+ * midisynth trugen davon identische Kopien. Hier bleiben nur dünne
+ * Wrapper: der Song lebt in einem McSong-Kontext, und beim Umwandeln
+ * bekommt jede Note ihre Kanalfarbe angehängt. */
+McSong song;
+
+void parse_midi(const char *filename) {
+    mc_song_init(&song);
+    mc_song_parse(&song, filename);
+}
 
-    *is_black = is_black_key(midi_note);
-    if (*is_black) {
-        *x = pos - (bk_width / 2.0f);
-        *w = bk_width;
-    } else {
-        *x = pos;
-        *w = wk_width;
+Note* convert_to_notes(size_t *count, double *duration) {
+    McNote *raw = mc_convert_to_notes(&song, count, duration);
+    Note *notes = malloc(sizeof(Note) * (*count > 0 ? *count : 1));
+    if (!notes) { fprintf(stderr, "Speicherfehler (Noten)\n"); exit(1); }
+    for (size_t i = 0; i < *count; i++) {
+        notes[i].start_time = raw[i].start_time;
+        notes[i].duration = raw[i].duration;
+        notes[i].midi_key = raw[i].midi_key;
+        notes[i].velocity = raw[i].velocity;
+        notes[i].channel = raw[i].channel;
+        notes[i].color = get_channel_color(raw[i].channel);
     }
+    free(raw);
+    return notes;
 }
 
 /* ==================================================================
-   MIDI-PARSER
+   NOTEN-SPEICHER (Structure of Arrays)
    ================================================================== */
-/* Wrapper für fread */
-void safe_fread(void *ptr, size_t size, size_t nmemb, FILE *stream) {
-    if (fread(ptr, size, nmemb, stream) != nmemb) {
-        fprintf(stderr, "Fehler: Unerwartetes Dateiende.\n");
+/* Der Sichtbarkeits-Scan in render_notes und der Scheduler der
+ * Streaming-Synthese lesen pro Note fast nur start_time und duration,
+ * holen mit dem 40-Byte-Note-Struct aber jedes Mal die ganze
+ * Cache-Line. Das Lied liegt deshalb als parallele Arrays vor: die
+ * Scans streamen dichte double-Arrays, die restlichen Felder werden
+ * erst beim Zeichnen bzw. Rendern einer konkreten Note angefasst. */
+typedef struct {
+    size_t count;
+    double *start;      /* sortiert nach Startzeit */
+    double *duration;
+    uint8_t *key;
+    uint8_t *velocity;
+    uint8_t *channel;
+    SDL_Color *color;
+} NoteList;
+
+/* Transponiert das sortierte Note-Array und gibt das Original frei */
+void notelist_build(NoteList *nl, Note *notes, size_t count) {
+    nl->count = count;
+    nl->start = malloc(count * sizeof(double));
+    nl->duration = malloc(count * sizeof(double));
+    nl->key = malloc(count * sizeof(uint8_t));
+    nl->velocity = malloc(count * sizeof(uint8_t));
+    nl->channel = malloc(count * sizeof(uint8_t));
+    nl->color = malloc(count * sizeof(SDL_Color));
+    if (!nl->start || !nl->duration || !nl->key ||
+        !nl->velocity || !nl->channel || !nl->color) {
+        fprintf(stderr, "Out of Memory (Noten).\n");
         exit(1);
     }
+    for (size_t i = 0; i < count; i++) {
+        nl->start[i] = notes[i].start_time;
+        nl->duration[i] = notes[i].duration;
+        nl->key[i] = (uint8_t)notes[i].midi_key;
+        nl->velocity[i] = (uint8_t)notes[i].velocity;
+        nl->channel[i] = (uint8_t)notes[i].channel;
+        nl->color[i] = notes[i].color;
+    }
+    free(notes);
+}
+
+/* Gather einer einzelnen Note für die Render-Funktionen */
+Note notelist_get(const NoteList *nl, size_t i) {
+    Note n;
+    n.start_time = nl->start[i];
+    n.duration = nl->duration[i];
+    n.midi_key = nl->key[i];
+    n.velocity = nl->velocity[i];
+    n.channel = nl->channel[i];
+    n.color = nl->color[i];
+    return n;
 }
 
-uint16_t read_be16(FILE *f) {
-    uint8_t bytes[2];
-    safe_fread(bytes, 1, 2, f);
-    return (uint16_t)((bytes[0] << 8) | bytes[1]);
+void notelist_free(NoteList *nl) {
+    free(nl->start);
+    free(nl->duration);
+    free(nl->key);
+    free(nl->velocity);
+    free(nl->channel);
+    free(nl->color);
+    memset(nl, 0, sizeof(*nl));
 }
 
-uint32_t read_be32(FILE *f) {
-    uint8_t bytes[4];
-    safe_fread(bytes, 1, 4, f);
-    return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) |
-           ((uint32_t)bytes[2] << 8) | bytes[3];
+/* ==================================================================
+   WAVETABLE-OSZILLATOR
+   ================================================================== */
+/* Eine vorberechnete Sinustabelle ersetzt die sin()-Aufrufe im
+ * Sample-Loop der Synthese. Die Phase läuft als 32-Bit-Festkomma-
+ * Akkumulator (ein voller Zyklus = 2^32); die oberen Bits indizieren
+ * die Tabelle, der Rest wird linear interpoliert. Ein Oszillator-
+ * Schritt ist damit nur noch ein Lookup plus ein Multiply-Add. */
+#define WAVETABLE_SIZE 4096
+#define WAVETABLE_FRAC_BITS 20
+#define WAVETABLE_FRAC_MASK ((1u << WAVETABLE_FRAC_BITS) - 1)
+
+/* Ein Wächter-Eintrag am Ende, damit die Interpolation nie wrappen muss */
+static float wavetable[WAVETABLE_SIZE + 1];
+
+void wavetable_init(void) {
+    for (int i = 0; i < WAVETABLE_SIZE; i++)
+        wavetable[i] = (float)sin(2.0 * PI * (double)i / WAVETABLE_SIZE);
+    wavetable[WAVETABLE_SIZE] = wavetable[0];
+}
+
+/* Phasen-Inkrement pro Sample für eine Frequenz */
+uint32_t wavetable_phase_inc(double freq) {
+    return (uint32_t)(freq * (4294967296.0 / SAMPLE_RATE));
 }
 
-uint32_t read_varlen(FILE *f) {
-    uint32_t value = 0;
-    uint8_t c;
-    do {
-        safe_fread(&c, 1, 1, f);
-        value = (value << 7) | (c & 0x7F);
-    } while (c & 0x80);
-    return value;
+float wavetable_sample(uint32_t phase) {
+    uint32_t idx = phase >> WAVETABLE_FRAC_BITS;
+    float frac = (float)(phase & WAVETABLE_FRAC_MASK) *
+        (1.0f / (float)(1u << WAVETABLE_FRAC_BITS));
+    return wavetable[idx] + (wavetable[idx + 1] - wavetable[idx]) * frac;
 }
 
-MidiEvent *events = NULL;
-size_t event_count = 0;
-size_t event_capacity = 0;
+/* ==================================================================
+   AUDIO-SYNTHESE (Memory Buffer)
+   ================================================================== */
+double midi_to_freq(int key) { return 440.0 * pow(2.0, (key - 69) / 12.0); }
 
-void add_event(MidiEvent e) {
-    if (event_count >= event_capacity) {
-        size_t new_capacity = (event_capacity == 0) ? 1024 : event_capacity * 2;
-        MidiEvent *temp = realloc(events, new_capacity * sizeof(MidiEvent));
-        if (temp == NULL) {
-            fprintf(stderr, "Error: Out of memory reallocating events.\n");
-            free(events);
-            exit(1);
+/* Additive Synthese-Parameter */
+static const double overtones[] = {1.0, 0.5, 0.3, 0.1};
+#define NUM_OVERTONES 4
+#define ENV_ATTACK 0.05
+#define ENV_RELEASE 0.1
+
+/* Branchfreier Mix-Loop für ein Hüllkurven-Segment: der Gain läuft
+ * als lineare Rampe mit (gain += dgain pro Sample), der Rumpf ist nur
+ * noch Oszillator-Lookups plus ein Multiply-Add -- eine Form, die der
+ * Compiler auto-vektorisieren kann. Die Phasen laufen in-place
+ * weiter, aufeinanderfolgende Segmente schließen also nahtlos an. */
+void render_segment(float *dst, size_t n,
+    uint32_t *phase, const uint32_t *phase_inc,
+    const float *osc_gain, int num_osc,
+    double gain, double dgain
+) {
+    for (size_t t = 0; t < n; t++) {
+        double val = 0.0;
+        for (int k = 0; k < num_osc; k++) {
+            val += osc_gain[k] * wavetable_sample(phase[k]);
+            phase[k] += phase_inc[k];
         }
-        events = temp;
-        event_capacity = new_capacity;
+        dst[t] += (float)(val * gain);
+        gain += dgain;
     }
-    events[event_count++] = e;
 }
 
-int compare_events(const void *a, const void *b) {
-    const MidiEvent *ea = (const MidiEvent *)a;
-    const MidiEvent *eb = (const MidiEvent *)b;
-    if (ea->abs_tick < eb->abs_tick) return -1;
-    if (ea->abs_tick > eb->abs_tick) return 1;
-    return 0;
-}
+/* Rendert eine einzelne Note additiv in den angegebenen Mix-Buffer
+ * (direkter Oszillator-Weg; füllt weiter unten auch den Noten-Cache).
+ * Die Hüllkurve wird vorab in ihre Segmente zerlegt -- Attack-Rampe,
+ * konstanter Sustain, Release-Rampe -- statt den Zweig pro Sample neu
+ * zu entscheiden. */
+void render_note_direct(float *mix_buf, size_t total_samples, const Note *np) {
+    int is_drum = (np->channel == 9);
+    double freq = is_drum ? 100.0 : midi_to_freq(np->midi_key);
+    double dur = is_drum ? 0.05 : np->duration;
+    double amp = (np->velocity / 127.0) * 0.3;
+
+    size_t start_s = (size_t)(np->start_time * SAMPLE_RATE);
+    size_t len_s = (size_t)((dur + ENV_RELEASE) * SAMPLE_RATE);
+
+    /* Ein Oszillator pro hörbarem Oberton; Inkremente und Gains
+     * einmal pro Note außerhalb des Sample-Loops aufsetzen */
+    uint32_t phase[4] = {0, 0, 0, 0};
+    uint32_t phase_inc[4];
+    float osc_gain[4];
+    int num_osc = 0;
+
+    if (is_drum) {
+        phase_inc[0] = wavetable_phase_inc(freq);
+        osc_gain[0] = 1.0f;
+        num_osc = 1;
+    } else {
+        for (int ov = 0; ov < NUM_OVERTONES; ov++) {
+            double h = freq * (ov + 1);
+            if (h < SAMPLE_RATE/2) {
+                phase_inc[num_osc] = wavetable_phase_inc(h);
+                /* Oberton-Normalisierung (Summe ca. 1.9) in den Gain falten */
+                osc_gain[num_osc] = (float)(overtones[ov] / 1.9);
+                num_osc++;
+            }
+        }
+    }
 
-void parse_midi(const char *filename, uint16_t *division) {
-    FILE *f = fopen(filename, "rb");
-    if (!f) {
-        fprintf(stderr, "Kann Datei nicht öffnen: %s\n", filename);
-        exit(1);
+    /* Segmentgrenzen in Note-lokalen Samples: der Release beginnt
+     * beim ersten Sample echt hinter der gehaltenen Dauer (wie der
+     * alte time > dur-Test); eine Note kürzer als der Attack rampt
+     * wie bisher bis a_end weiter. len_s endet, bevor die Release-
+     * Rampe negativ werden kann. */
+    if (start_s >= total_samples) return;
+    size_t t1 = len_s;
+    if (t1 > total_samples - start_s) t1 = total_samples - start_s;
+    size_t a_end = (size_t)(ENV_ATTACK * SAMPLE_RATE);
+    size_t r_start = (size_t)(dur * SAMPLE_RATE) + 1;
+    double att_slope = 1.0 / (ENV_ATTACK * SAMPLE_RATE);
+    double rel_slope = 1.0 / (ENV_RELEASE * SAMPLE_RATE);
+    size_t t0 = 0;
+
+    if (t0 < a_end && t0 < t1) { /* Attack */
+        size_t seg_end = (a_end < t1) ? a_end : t1;
+        render_segment(mix_buf + start_s + t0, seg_end - t0,
+            phase, phase_inc, osc_gain, num_osc,
+            amp * ((double)t0 * att_slope), amp * att_slope);
+        t0 = seg_end;
     }
+    if (t0 < r_start && t0 < t1) { /* Sustain */
+        size_t seg_end = (r_start < t1) ? r_start : t1;
+        render_segment(mix_buf + start_s + t0, seg_end - t0,
+            phase, phase_inc, osc_gain, num_osc, amp, 0.0);
+        t0 = seg_end;
+    }
+    if (t0 < t1) { /* Release */
+        double env0 = 1.0 - ((double)t0 / SAMPLE_RATE - dur) / ENV_RELEASE;
+        render_segment(mix_buf + start_s + t0, t1 - t0,
+            phase, phase_inc, osc_gain, num_osc,
+            amp * env0, -amp * rel_slope);
+    }
+}
 
-    char chunk_id[5] = {0};
-    safe_fread(chunk_id, 1, 4, f);
-    if (strcmp(chunk_id, "MThd") != 0) {
-        fprintf(stderr, "Kein gültiges MIDI.\n");
-        exit(1);
+/* ==================================================================
+   SIMD-KERNELS
+   ================================================================== */
+/* Vektorisierte Helfer für die drei Pässe, die über den kompletten
+ * Sample-Buffer streamen: Aufsummieren der Thread-Buffer, Peak-Scan
+ * für die Normalisierung und das Skalieren/Clampen nach int16.
+ * SSE2/AVX2 auf x86, NEON auf ARM; sonst übernimmt der skalare
+ * Rest-Loop jeweils den ganzen Buffer. */
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/* dst[i] += src[i] */
+void mix_accumulate(float *dst, const float *src, size_t n) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(dst + i, _mm256_add_ps(
+            _mm256_loadu_ps(dst + i), _mm256_loadu_ps(src + i)));
+    }
+#elif defined(__SSE2__)
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_ps(dst + i, _mm_add_ps(
+            _mm_loadu_ps(dst + i), _mm_loadu_ps(src + i)));
     }
+#elif defined(__ARM_NEON)
+    for (; i + 4 <= n; i += 4) {
+        vst1q_f32(dst + i, vaddq_f32(vld1q_f32(dst + i), vld1q_f32(src + i)));
+    }
+#endif
+    for (; i < n; i++) dst[i] += src[i];
+}
 
-    read_be32(f); read_be16(f); /* Skip len/fmt */
-    uint16_t num_tracks = read_be16(f);
-    *division = read_be16(f);
+/* dst[i] += src[i] * gain */
+void mix_scaled(float *dst, const float *src, size_t n, float gain) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    __m256 g = _mm256_set1_ps(gain);
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i),
+            _mm256_mul_ps(_mm256_loadu_ps(src + i), g)));
+    }
+#elif defined(__SSE2__)
+    __m128 g = _mm_set1_ps(gain);
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i),
+            _mm_mul_ps(_mm_loadu_ps(src + i), g)));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 4 <= n; i += 4) {
+        vst1q_f32(dst + i,
+            vmlaq_n_f32(vld1q_f32(dst + i), vld1q_f32(src + i), gain));
+    }
+#endif
+    for (; i < n; i++) dst[i] += src[i] * gain;
+}
 
-    if (*division & 0x8000) {
-        fprintf(stderr, "SMPTE nicht unterstützt.\n");
-        exit(1);
+/* Größter Absolutwert im Buffer */
+float peak_abs(const float *buf, size_t n) {
+    size_t i = 0;
+    float peak = 0.0f;
+#if defined(__AVX2__)
+    {
+        __m256 vmax = _mm256_setzero_ps();
+        const __m256 sign = _mm256_set1_ps(-0.0f);
+        float lanes[8];
+        for (; i + 8 <= n; i += 8) {
+            vmax = _mm256_max_ps(vmax,
+                _mm256_andnot_ps(sign, _mm256_loadu_ps(buf + i)));
+        }
+        _mm256_storeu_ps(lanes, vmax);
+        for (int k = 0; k < 8; k++) if (lanes[k] > peak) peak = lanes[k];
+    }
+#elif defined(__SSE2__)
+    {
+        __m128 vmax = _mm_setzero_ps();
+        const __m128 sign = _mm_set1_ps(-0.0f);
+        float lanes[4];
+        for (; i + 4 <= n; i += 4) {
+            vmax = _mm_max_ps(vmax,
+                _mm_andnot_ps(sign, _mm_loadu_ps(buf + i)));
+        }
+        _mm_storeu_ps(lanes, vmax);
+        for (int k = 0; k < 4; k++) if (lanes[k] > peak) peak = lanes[k];
     }
+#elif defined(__ARM_NEON)
+    {
+        float32x4_t vmax = vdupq_n_f32(0.0f);
+        float lanes[4];
+        for (; i + 4 <= n; i += 4) {
+            vmax = vmaxq_f32(vmax, vabsq_f32(vld1q_f32(buf + i)));
+        }
+        vst1q_f32(lanes, vmax);
+        for (int k = 0; k < 4; k++) if (lanes[k] > peak) peak = lanes[k];
+    }
+#endif
+    for (; i < n; i++) {
+        float a = fabsf(buf[i]);
+        if (a > peak) peak = a;
+    }
+    return peak;
+}
 
-    for (int t = 0; t < num_tracks; t++) {
-        safe_fread(chunk_id, 1, 4, f);
-        while (strcmp(chunk_id, "MTrk") != 0) {
-            uint32_t skip = read_be32(f);
-            fseek(f, skip, SEEK_CUR);
-            safe_fread(chunk_id, 1, 4, f);
+/* dst[i] = clamp(src[i] * scale) als int16. Die Pack-Instruktionen
+ * saturieren, die Vektor-Pfade brauchen daher kein explizites Clamping. */
+void quantize_to_i16(int16_t *dst, const float *src, size_t n, float scale) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    {
+        const __m256 vs = _mm256_set1_ps(scale);
+        for (; i + 8 <= n; i += 8) {
+            __m256i v = _mm256_cvtps_epi32(
+                _mm256_mul_ps(_mm256_loadu_ps(src + i), vs));
+            __m128i p = _mm_packs_epi32(_mm256_castsi256_si128(v),
+                _mm256_extracti128_si256(v, 1));
+            _mm_storeu_si128((__m128i *)(dst + i), p);
         }
-        uint32_t track_len = read_be32(f);
-        long track_end = ftell(f) + track_len;
-        uint32_t abs_tick = 0;
-        uint8_t running_status = 0;
+    }
+#elif defined(__SSE2__)
+    {
+        const __m128 vs = _mm_set1_ps(scale);
+        for (; i + 8 <= n; i += 8) {
+            __m128i lo = _mm_cvtps_epi32(
+                _mm_mul_ps(_mm_loadu_ps(src + i), vs));
+            __m128i hi = _mm_cvtps_epi32(
+                _mm_mul_ps(_mm_loadu_ps(src + i + 4), vs));
+            _mm_storeu_si128((__m128i *)(dst + i), _mm_packs_epi32(lo, hi));
+        }
+    }
+#elif defined(__ARM_NEON)
+    {
+        const float32x4_t vs = vdupq_n_f32(scale);
+        for (; i + 4 <= n; i += 4) {
+            int32x4_t v = vcvtq_s32_f32(vmulq_f32(vld1q_f32(src + i), vs));
+            vst1_s16(dst + i, vqmovn_s32(v));
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        int32_t val = (int32_t)(src[i] * scale);
+        if (val > 32767) val = 32767;
+        if (val < -32768) val = -32768;
+        dst[i] = (int16_t)val;
+    }
+}
 
-        while (ftell(f) < track_end) {
-            abs_tick += read_varlen(f);
-            uint8_t byte;
-            safe_fread(&byte, 1, 1, f);
+/* ==================================================================
+   GETEILTE DRUM-STIMME
+   ================================================================== */
+/* Jeder Kanal-9-Schlag ist derselbe feste 100-Hz-Burst mit derselben
+ * Hüllkurve; nur die Velocity unterscheidet sich, und die geht linear
+ * in den Samplewert ein. Der kanonische Burst wird also genau einmal
+ * mit voller Velocity gerendert, jeder Schlag ist danach ein einziger
+ * skalierter Buffer-Add. */
+float *drum_pcm = NULL;
+size_t drum_pcm_len = 0;
+
+void drum_voice_init(void) {
+    if (drum_pcm) return;
+    drum_pcm_len = (size_t)((0.05 + ENV_RELEASE) * SAMPLE_RATE);
+    drum_pcm = calloc(drum_pcm_len, sizeof(float));
+    if (!drum_pcm) { drum_pcm_len = 0; return; } /* dann eben direkt */
+    Note proto = {0.0, 0.05, 0, 127, 9, {0, 0, 0, 0}};
+    render_note_direct(drum_pcm, drum_pcm_len, &proto);
+}
 
-            uint8_t status;
-            if (byte >= 0x80) {
-                status = byte;
-                running_status = status;
-            } else {
-                if (running_status == 0) {
-                    /* printf("Datenbyte ohne Status ignoriert\n"); */
-                    continue;
-                }
-                status = running_status;
-                fseek(f, -1, SEEK_CUR);
-            }
-            if (status == 0xFF) {
-                uint8_t type; safe_fread(&type, 1, 1, f);
-                uint32_t len = read_varlen(f);
-                if (type == 0x51 && len == 3) {
-                    uint8_t tb[3]; safe_fread(tb, 1, 3, f);
-                    int micros = (tb[0]<<16) | (tb[1]<<8) | tb[2];
-                    MidiEvent e = {abs_tick, EVENT_SET_TEMPO, 0, 0, 0, micros};
-                    add_event(e);
-                } else fseek(f, len, SEEK_CUR);
-            } else if (status == 0xF0 || status == 0xF7) {
-                fseek(f, read_varlen(f), SEEK_CUR);
-            } else if ((status & 0xF0) == 0x90 || (status & 0xF0) == 0x80) {
-                uint8_t n, v; safe_fread(&n, 1, 1, f); safe_fread(&v, 1, 1, f);
-                int is_on = ((status & 0xF0) == 0x90) && (v > 0);
-                MidiEvent e = {
-                    abs_tick,
-                    is_on ? EVENT_NOTE_ON : EVENT_NOTE_OFF,
-                    status & 0x0F, n, v, 0
-                };
-                add_event(e);
-            } else {
-                fseek(f, ((status & 0xF0) == 0xC0 || (status & 0xF0) == 0xD0) ? 1 : 2, SEEK_CUR);
-            }
+void drum_voice_free(void) {
+    free(drum_pcm);
+    drum_pcm = NULL;
+    drum_pcm_len = 0;
+}
+
+/* ==================================================================
+   NOTEN-PCM-CACHE
+   ================================================================== */
+/* Dieselbe Stimme (Taste, Velocity, auf 1 ms gerundete Dauer) taucht
+ * in echten Stücken hundertfach auf -- eine wiederholte Begleitfigur
+ * wurde bisher bei jedem Vorkommen neu synthetisiert. Jede
+ * einzigartige Stimme wird einmal in einen PCM-Schnipsel gerendert,
+ * alle weiteren Vorkommen sind nur noch ein vektorisierter Buffer-Add.
+ * Offene Adressierung mit linearem Sondieren, keine Verdrängung: Ist
+ * das Byte-Budget aufgebraucht oder die Stimme zu lang, geht es den
+ * direkten Weg. */
+#define NOTE_CACHE_SLOTS 4096 /* Zweierpotenz */
+#define NOTE_CACHE_MAX_BYTES (64u << 20)
+#define NOTE_CACHE_MAX_DUR_MS 20000u
+#define NOTE_CACHE_MAX_PROBES 32
+
+typedef struct {
+    uint32_t key; /* 0 = leerer Slot (Velocity 0 kommt nie vor) */
+    float *pcm;
+    size_t len;
+} CachedVoice;
+
+CachedVoice note_cache[NOTE_CACHE_SLOTS];
+size_t note_cache_bytes = 0;
+SDL_mutex *note_cache_lock = NULL;
+
+/* Einmalig vor dem Start der Synthese-Worker aufrufen */
+void note_cache_init(void) {
+    if (!note_cache_lock) note_cache_lock = SDL_CreateMutex();
+}
+
+/* Stimmen-Parameter in den Hash-Key packen; 0 = nicht cachebar.
+ * Kanal 9 landet hier nie: Drums teilen sich den vorgerenderten
+ * Burst von oben. */
+uint32_t note_cache_key(const Note *np, double *out_dur) {
+    uint32_t dur_ms = (uint32_t)(np->duration * 1000.0 + 0.5);
+    if (dur_ms > NOTE_CACHE_MAX_DUR_MS) return 0;
+    *out_dur = dur_ms / 1000.0;
+    return (dur_ms << 15) | ((uint32_t)np->velocity << 8) | (uint32_t)np->midi_key;
+}
+
+/* Schnipsel für diese Stimme suchen oder anlegen; NULL = direkt
+ * rendern. Der Mutex deckt auch das einmalige Rendern einer neuen
+ * Stimme ab -- das serialisiert Erstvorkommen, garantiert aber, dass
+ * kein Worker einen halbfertigen Schnipsel sieht. */
+const CachedVoice* note_cache_fetch(const Note *np) {
+    double dur = 0.0;
+    uint32_t key = note_cache_key(np, &dur);
+    if (key == 0) return NULL;
+    size_t slot = (size_t)(key * 2654435761u) & (NOTE_CACHE_SLOTS - 1);
+    const CachedVoice *hit = NULL;
+
+    if (note_cache_lock) SDL_LockMutex(note_cache_lock);
+    for (size_t p = 0; p < NOTE_CACHE_MAX_PROBES; p++) {
+        CachedVoice *c = &note_cache[(slot + p) & (NOTE_CACHE_SLOTS - 1)];
+        if (c->key == key) { hit = c; break; }
+        if (c->key == 0) {
+            size_t len = (size_t)((dur + ENV_RELEASE) * SAMPLE_RATE);
+            if (len == 0 ||
+                note_cache_bytes + len * sizeof(float) > NOTE_CACHE_MAX_BYTES)
+                break;
+            c->pcm = calloc(len, sizeof(float));
+            if (!c->pcm) break;
+            /* Die kanonische Stimme einmal bei t=0 rendern */
+            Note proto = *np;
+            proto.start_time = 0.0;
+            proto.duration = dur;
+            render_note_direct(c->pcm, len, &proto);
+            c->len = len;
+            c->key = key;
+            note_cache_bytes += len * sizeof(float);
+            hit = c;
+            break;
         }
     }
-    fclose(f);
-    qsort(events, event_count, sizeof(MidiEvent), compare_events);
+    if (note_cache_lock) SDL_UnlockMutex(note_cache_lock);
+    return hit;
 }
 
-Note* convert_to_notes(uint16_t division, size_t *count, double *duration) {
-    Note *notes = malloc(sizeof(Note) * event_count);
-    size_t idx = 0;
-    double cur_time = 0.0, micros_per_beat = 500000.0;
-    uint32_t cur_tick = 0;
+/* Note über Cache bzw. Drum-Burst mischen: Ein Treffer kostet nur
+ * noch einen geclippten Buffer-Add statt des Oszillator-Laufs */
+void render_note(float *mix_buf, size_t total_samples, const Note *np) {
+    size_t start_s = (size_t)(np->start_time * SAMPLE_RATE);
+    if (start_s >= total_samples) return;
 
-    /* Tracking aktiver Noten: [Channel][Note] -> StartTime. -1 = inaktiv */
-    double active_times[16][128];
-    int active_vels[16][128];
-    for(int c=0; c<16; c++) for(int n=0; n<128; n++) active_times[c][n] = -1.0;
+    if (np->channel == 9 && drum_pcm) {
+        size_t n = drum_pcm_len;
+        if (start_s + n > total_samples) n = total_samples - start_s;
+        mix_scaled(mix_buf + start_s, drum_pcm, n, np->velocity / 127.0f);
+        return;
+    }
 
-    for (size_t i = 0; i < event_count; i++) {
-        MidiEvent e = events[i];
-        if (e.abs_tick > cur_tick) {
-            cur_time += (e.abs_tick - cur_tick) * (micros_per_beat / 1000000.0) / division;
-            cur_tick = e.abs_tick;
-        }
-        if (e.type == EVENT_SET_TEMPO) micros_per_beat = e.tempo_micros;
-        else if (e.type == EVENT_NOTE_ON) {
-            if (active_times[e.channel][e.note] >= 0) { /* Retrigger */
-                Note n = {active_times[e.channel][e.note], cur_time - active_times[e.channel][e.note],
-                          e.note, active_vels[e.channel][e.note], e.channel, get_channel_color(e.channel)};
-                if(n.duration > 0) notes[idx++] = n;
-            }
-            active_times[e.channel][e.note] = cur_time;
-            active_vels[e.channel][e.note] = e.velocity;
-        } else if (e.type == EVENT_NOTE_OFF) {
-            if (active_times[e.channel][e.note] >= 0) {
-                Note n = {active_times[e.channel][e.note], cur_time - active_times[e.channel][e.note],
-                          e.note, active_vels[e.channel][e.note], e.channel, get_channel_color(e.channel)};
-                active_times[e.channel][e.note] = -1.0;
-                if(n.duration > 0) notes[idx++] = n;
-            }
-        }
+    const CachedVoice *cv = (np->channel != 9) ? note_cache_fetch(np) : NULL;
+    if (!cv) { render_note_direct(mix_buf, total_samples, np); return; }
+    size_t n = cv->len;
+    if (start_s + n > total_samples) n = total_samples - start_s;
+    mix_accumulate(mix_buf + start_s, cv->pcm, n);
+}
+
+void note_cache_free(void) {
+    for (size_t i = 0; i < NOTE_CACHE_SLOTS; i++) {
+        if (note_cache[i].key) free(note_cache[i].pcm);
+        note_cache[i] = (CachedVoice){0, NULL, 0};
+    }
+    note_cache_bytes = 0;
+    if (note_cache_lock) {
+        SDL_DestroyMutex(note_cache_lock);
+        note_cache_lock = NULL;
     }
-    *count = idx;
-    *duration = cur_time + 1.0;
-    return notes;
 }
 
 /* ==================================================================
-   AUDIO-SYNTHESE (Memory Buffer)
+   PARALLELE NOTEN-SYNTHESE
    ================================================================== */
-double midi_to_freq(int key) { return 440.0 * pow(2.0, (key - 69) / 12.0); }
+/* Das Noten-Array wird auf Worker-Threads (SDL-Threads, damit keine
+ * neue Abhängigkeit dazukommt) aufgeteilt. Jeder Worker mischt seinen
+ * Anteil in einen privaten Buffer voller Länge -- kein Locking nötig;
+ * am Ende werden die Buffer aufsummiert. */
+#define MAX_SYNTH_THREADS 16
+
+typedef struct {
+    const NoteList *nl;
+    size_t begin;
+    size_t end;
+    float *mix;
+    size_t total_samples;
+} SynthJob;
+
+int synth_worker(void *arg) {
+    SynthJob *job = (SynthJob *)arg;
+    for (size_t i = job->begin; i < job->end; i++) {
+        Note n = notelist_get(job->nl, i);
+        render_note(job->mix, job->total_samples, &n);
+    }
+    return 0;
+}
 
-void synthesize_to_ram(const Note *notes, size_t count, double duration, AudioContext *ctx) {
+/* Wie viele Worker lohnen sich für diese Notenanzahl? */
+int synth_thread_count(size_t note_count) {
+    int cores = SDL_GetCPUCount();
+    long want = (long)(note_count / 256) + 1;
+    if (cores < 1) cores = 1;
+    if (cores > MAX_SYNTH_THREADS) cores = MAX_SYNTH_THREADS;
+    if (want < cores) cores = (int)want;
+    return cores;
+}
+
+/* Rendert alle Noten in mix_buf, parallel wenn möglich. */
+void render_notes_parallel(
+    float *mix_buf, size_t total_samples, const NoteList *nl
+) {
+    size_t note_count = nl->count;
+    int num_threads = synth_thread_count(note_count);
+    SDL_Thread *threads[MAX_SYNTH_THREADS];
+    SynthJob jobs[MAX_SYNTH_THREADS];
+    int started = 0;
+    int i;
+
+    for (i = 0; i < num_threads; i++) {
+        jobs[i].nl = nl;
+        jobs[i].begin = note_count * i / num_threads;
+        jobs[i].end = note_count * (i + 1) / num_threads;
+        jobs[i].total_samples = total_samples;
+        /* Thread 0 läuft im Hauptthread und nutzt den Haupt-Buffer */
+        jobs[i].mix = (i == 0) ? mix_buf : calloc(total_samples, sizeof(float));
+        if (jobs[i].mix == NULL) break;
+    }
+    num_threads = i;
+
+    for (i = 1; i < num_threads; i++) {
+        threads[i] = SDL_CreateThread(synth_worker, "synth", &jobs[i]);
+        if (threads[i] == NULL) break;
+        started = i;
+    }
+
+    /* Der Hauptthread arbeitet an Slice 0, während die Worker laufen */
+    synth_worker(&jobs[0]);
+
+    for (i = 1; i <= started; i++) {
+        SDL_WaitThread(threads[i], NULL);
+        mix_accumulate(mix_buf, jobs[i].mix, total_samples);
+    }
+    for (i = 1; i < num_threads; i++) free(jobs[i].mix);
+
+    /* Slices ohne Buffer oder Thread seriell nachholen */
+    size_t rest = (started + 1 < num_threads)
+        ? jobs[started + 1].begin
+        : (num_threads > 0 ? jobs[num_threads - 1].end : 0);
+    for (size_t n = rest; n < note_count; n++) {
+        Note nt = notelist_get(nl, n);
+        render_note(mix_buf, total_samples, &nt);
+    }
+}
+
+void synthesize_to_ram(const NoteList *nl, double duration, AudioContext *ctx) {
     size_t total_samples = (size_t)(duration * SAMPLE_RATE);
     ctx->total_samples = total_samples;
     ctx->play_cursor = 0;
@@ -318,68 +804,513 @@ void synthesize_to_ram(const Note *notes, size_t count, double duration, AudioCo
     float *mix_buf = calloc(total_samples, sizeof(float));
     if(!mix_buf) { fprintf(stderr, "Out of Memory (Audio).\n"); exit(1); }
 
-    printf("Synthetisiere %zu Noten (%.1f s)...\n", count, duration);
+    printf("Synthetisiere %zu Noten (%.1f s)...\n", nl->count, duration);
 
-    const double overtones[] = {1.0, 0.5, 0.3, 0.1};
-    int num_overtones = 4;
-    double release = 0.1;
+    wavetable_init();
+    drum_voice_init();
+    note_cache_init();
 
-    for (size_t i = 0; i < count; i++) {
-        Note n = notes[i];
-        int is_drum = (n.channel == 9);
-        double freq = is_drum ? 100.0 : midi_to_freq(n.midi_key);
-        double dur = is_drum ? 0.05 : n.duration;
-        double amp = (n.velocity / 127.0) * 0.3;
-
-        size_t start_s = (size_t)(n.start_time * SAMPLE_RATE);
-        size_t len_s = (size_t)((dur + release) * SAMPLE_RATE);
-
-        for (size_t t = 0; t < len_s && (start_s + t) < total_samples; t++) {
-            double time = (double)t / SAMPLE_RATE;
-            double val = 0.0;
-
-            if (is_drum) val = sin(2 * PI * freq * time);
-            else {
-                for(int ov=0; ov<num_overtones; ov++) {
-                    double h = freq * (ov + 1);
-                    if (h < SAMPLE_RATE/2) val += overtones[ov] * sin(2 * PI * h * time);
-                }
-                val /= 1.9;
+    render_notes_parallel(mix_buf, total_samples, nl);
+
+    /* Normalisierung und Konvertierung zu int16 */
+    float max_val = peak_abs(mix_buf, total_samples);
+
+    float norm = (max_val > 0) ? (32000.0f / max_val) : 1.0f;
+    if (norm > 32000.0f) norm = 32000.0f;
+
+    ctx->pcm_buffer = malloc(total_samples * sizeof(int16_t));
+    quantize_to_i16(ctx->pcm_buffer, mix_buf, total_samples, norm);
+    ctx->samples_ready = total_samples;
+    free(mix_buf);
+}
+
+/* ==================================================================
+   PCM-SIDECAR-CACHE
+   ================================================================== */
+/* Wer dieselbe Datei zum zwanzigsten Mal öffnet, soll nicht zum
+ * zwanzigsten Mal synthetisieren. Nach einem vollständig gerenderten
+ * Lauf wird das fertige int16-PCM samt sortiertem Noten-Array als
+ * Sidecar neben die .mid geschrieben (<datei>.mivicache); beim
+ * nächsten Start wird das Sidecar validiert (Magic, Version, Engine,
+ * Größe und mtime der Quelldatei) und per mmap direkt als pcm_buffer und
+ * Noten-Array eingeblendet. Der Warmstart kostet dann nur noch das
+ * Einblenden -- die eigentliche I/O erledigt der Page-Cache. */
+#define SIDECAR_MAGIC 0x31564D43u /* "CMV1" */
+#define SIDECAR_VERSION 4 /* v2: Noten als SoA-Arrays statt Note-Structs;
+                             v3: PCM vom Streaming-Limiter statt Fixgain;
+                             v4: Engine-Feld im Header */
+#define SIDECAR_SUFFIX ".mivicache"
+
+/* Welcher Synthesizer das PCM erzeugt hat: ein -tm-Lauf darf keinen
+ * intern synthetisierten Sidecar serviert bekommen und umgekehrt */
+#define SIDECAR_ENGINE_INTERN 0u
+#define SIDECAR_ENGINE_TIMIDITY 1u
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t src_size;    /* Invalidierung: Quelldatei geändert? */
+    int64_t  src_mtime;
+    uint64_t note_count;
+    uint64_t total_samples;
+    double   duration;
+    uint32_t engine;      /* SIDECAR_ENGINE_* */
+    uint32_t reserved;    /* Padding, immer 0 */
+} SidecarHeader;
+
+/* Aktives Mapping, damit der Cleanup munmap statt free ruft */
+static void *sidecar_map = NULL;
+static size_t sidecar_map_len = 0;
+
+char *sidecar_path(const char *midifile) {
+    size_t len = strlen(midifile);
+    char *path = malloc(len + sizeof(SIDECAR_SUFFIX));
+    if (!path) { fprintf(stderr, "Out of Memory.\n"); exit(1); }
+    memcpy(path, midifile, len);
+    memcpy(path + len, SIDECAR_SUFFIX, sizeof(SIDECAR_SUFFIX));
+    return path;
+}
+
+#ifndef _WIN32
+int sidecar_src_stat(const char *midifile, uint64_t *size, int64_t *mtime) {
+    struct stat st;
+    if (stat(midifile, &st) != 0) return 0;
+    *size = (uint64_t)st.st_size;
+    *mtime = (int64_t)st.st_mtime;
+    return 1;
+}
+#endif
+
+/* Dateilayout nach dem Header: die sechs SoA-Arrays in fester
+ * Reihenfolge, jedes auf 8 Bytes aufgerundet, dann das PCM. */
+size_t sidecar_align8(size_t off) {
+    return (off + 7u) & ~(size_t)7u;
+}
+
+/* Versucht den Sidecar zu laden; bei Treffer zeigen die NoteList-
+ * Arrays und ctx->pcm_buffer in das Mapping und dürfen nicht
+ * freigegeben werden. Jeder Fehler ist ein stiller Miss -- der Cache
+ * ist nur eine Abkürzung, kein Fehlerfall. engine ist die Engine des
+ * aktuellen Laufs; ein Sidecar der jeweils anderen ist ein Miss. */
+int sidecar_load(const char *midifile, uint32_t engine, NoteList *nl,
+    double *out_duration, AudioContext *ctx
+) {
+#ifndef _WIN32
+    uint64_t src_size;
+    int64_t src_mtime;
+    char *path;
+    int fd;
+    struct stat st;
+    uint8_t *map;
+    SidecarHeader hdr;
+    size_t count, off, need;
+
+    if (!sidecar_src_stat(midifile, &src_size, &src_mtime)) return 0;
+
+    path = sidecar_path(midifile);
+    fd = open(path, O_RDONLY);
+    free(path);
+    if (fd < 0) return 0;
+
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SidecarHeader)) {
+        close(fd);
+        return 0;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return 0;
+
+    memcpy(&hdr, map, sizeof(hdr));
+    count = (size_t)hdr.note_count;
+    need = sizeof(hdr);
+    need = sidecar_align8(need + count * sizeof(double));   /* start */
+    need = sidecar_align8(need + count * sizeof(double));   /* duration */
+    need = sidecar_align8(need + count * sizeof(SDL_Color));
+    need = sidecar_align8(need + count);                    /* key */
+    need = sidecar_align8(need + count);                    /* velocity */
+    need = sidecar_align8(need + count);                    /* channel */
+    need += (size_t)hdr.total_samples * sizeof(int16_t);
+    if (hdr.magic != SIDECAR_MAGIC || hdr.version != SIDECAR_VERSION ||
+        hdr.engine != engine ||
+        hdr.src_size != src_size || hdr.src_mtime != src_mtime ||
+        (size_t)st.st_size < need) {
+        munmap(map, st.st_size);
+        return 0;
+    }
+
+    sidecar_map = map;
+    sidecar_map_len = (size_t)st.st_size;
+
+    nl->count = count;
+    off = sizeof(hdr);
+    nl->start = (double *)(map + off);
+    off = sidecar_align8(off + count * sizeof(double));
+    nl->duration = (double *)(map + off);
+    off = sidecar_align8(off + count * sizeof(double));
+    nl->color = (SDL_Color *)(map + off);
+    off = sidecar_align8(off + count * sizeof(SDL_Color));
+    nl->key = map + off;
+    off = sidecar_align8(off + count);
+    nl->velocity = map + off;
+    off = sidecar_align8(off + count);
+    nl->channel = map + off;
+    off = sidecar_align8(off + count);
+
+    *out_duration = hdr.duration;
+    ctx->pcm_buffer = (int16_t *)(map + off);
+    ctx->total_samples = (size_t)hdr.total_samples;
+    ctx->samples_ready = (size_t)hdr.total_samples;
+    ctx->play_cursor = 0;
+
+    printf("Sidecar-Cache: %zu Noten, %.1f s (ohne Synthese).\n",
+        count, *out_duration);
+    return 1;
+#else
+    (void)midifile; (void)engine; (void)nl; (void)out_duration; (void)ctx;
+    return 0;
+#endif
+}
+
+#ifndef _WIN32
+/* fwrite plus Null-Padding bis zur nächsten 8-Byte-Grenze */
+int sidecar_write_padded(FILE *f, const void *data, size_t len) {
+    static const uint8_t zero[8] = {0};
+    size_t pad = sidecar_align8(len) - len;
+    if (len > 0 && fwrite(data, 1, len, f) != len) return 0;
+    if (pad > 0 && fwrite(zero, 1, pad, f) != pad) return 0;
+    return 1;
+}
+#endif
+
+/* Schreibt den Sidecar nach einer vollständigen Synthese. Bricht bei
+ * Schreibfehlern ab und räumt die halbe Datei weg; der nächste Start
+ * fällt dann einfach auf die Synthese zurück. */
+void sidecar_save(const char *midifile, uint32_t engine, const NoteList *nl,
+    double duration, const AudioContext *ctx
+) {
+#ifndef _WIN32
+    uint64_t src_size;
+    int64_t src_mtime;
+    char *path;
+    FILE *f;
+    SidecarHeader hdr;
+    int ok;
+
+    if (!sidecar_src_stat(midifile, &src_size, &src_mtime)) return;
+
+    path = sidecar_path(midifile);
+    f = fopen(path, "wb");
+    if (!f) { free(path); return; }
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = SIDECAR_MAGIC;
+    hdr.version = SIDECAR_VERSION;
+    hdr.src_size = src_size;
+    hdr.src_mtime = src_mtime;
+    hdr.note_count = nl->count;
+    hdr.total_samples = ctx->total_samples;
+    hdr.duration = duration;
+    hdr.engine = engine;
+
+    ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1 &&
+         sidecar_write_padded(f, nl->start, nl->count * sizeof(double)) &&
+         sidecar_write_padded(f, nl->duration, nl->count * sizeof(double)) &&
+         sidecar_write_padded(f, nl->color, nl->count * sizeof(SDL_Color)) &&
+         sidecar_write_padded(f, nl->key, nl->count) &&
+         sidecar_write_padded(f, nl->velocity, nl->count) &&
+         sidecar_write_padded(f, nl->channel, nl->count) &&
+         fwrite(ctx->pcm_buffer, sizeof(int16_t), ctx->total_samples, f)
+            == ctx->total_samples;
+    if (fclose(f) != 0) ok = 0;
+
+    if (!ok) remove(path);
+    else printf("Sidecar-Cache geschrieben: %s\n", path);
+    free(path);
+#else
+    (void)midifile; (void)engine; (void)nl; (void)duration; (void)ctx;
+#endif
+}
+
+void sidecar_unload(void) {
+#ifndef _WIN32
+    if (sidecar_map) {
+        munmap(sidecar_map, sidecar_map_len);
+        sidecar_map = NULL;
+        sidecar_map_len = 0;
+    }
+#endif
+}
+
+/* ==================================================================
+   STREAMING-LIMITER
+   ================================================================== */
+/* Streaming kann nicht normalisieren: der globale Peak steht erst
+ * nach dem letzten Sample fest, und ihn zu suchen plus zu skalieren
+ * kostet zwei volle Durchläufe über den Float-Mix. Der Limiter ersetzt
+ * beides durch einen Durchlauf: Blöcke werden quantisiert, sobald sie
+ * fertig gemischt sind, mit einem Gain, der einer laufenden
+ * Peak-Hüllkurve folgt. Unterhalb des Knees gilt der feste Basis-Gain
+ * unverändert; darüber nähert sich die Ausgabe über ein rationales
+ * Soft-Knee der Decke, statt im Quantizer hart zu clippen. Der
+ * Aufrufer reicht den Peak des NÄCHSTEN Blocks als Lookahead herein,
+ * damit der Gain schon im Block davor herunterfährt. */
+#define LIMITER_BASE_GAIN 9000.0f   /* nominale Lautstärke wie bisher */
+#define LIMITER_CEILING 32000.0f
+#define LIMITER_KNEE 24000.0f
+#define LIMITER_RELEASE 3.0         /* Halbwertszeit der Hüllkurve in s */
+
+typedef struct {
+    float env;   /* laufende Peak-Hüllkurve (vor dem Gain) */
+    float gain;  /* Gain am Ende des letzten Blocks */
+    int primed;  /* erster Block springt direkt auf sein Ziel-Gain */
+} Limiter;
+
+void limiter_init(Limiter *lim) {
+    lim->env = 0.0f;
+    lim->gain = LIMITER_BASE_GAIN;
+    lim->primed = 0;
+}
+
+/* Gain, der einen Peak mit Soft-Knee unterhalb der Decke hält */
+float limiter_gain_for_peak(float peak) {
+    float raw = peak * LIMITER_BASE_GAIN;
+    float over, span;
+    if (peak <= 0.0f || raw <= LIMITER_KNEE) return LIMITER_BASE_GAIN;
+    /* Rationales Knee: steigt vom Knee Richtung Decke, erreicht sie
+     * nie, und ist am Knee in Wert und Steigung stetig */
+    over = raw - LIMITER_KNEE;
+    span = LIMITER_CEILING - LIMITER_KNEE;
+    return (LIMITER_KNEE + span * over / (over + span)) / peak;
+}
+
+/* Skalieren mit linearer Gain-Rampe und Begrenzen; dieselbe
+ * autovektorisierbare Form wie render_segment */
+void limiter_quantize(int16_t *dst, const float *src, size_t n,
+    float g0, float g1
+) {
+    float g = g0;
+    float dg = (n > 0) ? (g1 - g0) / (float)n : 0.0f;
+    for (size_t t = 0; t < n; t++) {
+        float v = src[t] * g;
+        if (v > 32767.0f) v = 32767.0f;
+        if (v < -32768.0f) v = -32768.0f;
+        dst[t] = (int16_t)v;
+        g += dg;
+    }
+}
+
+/* Quantisiert einen fertigen Block. peak ist dessen eigener Peak (vom
+ * Aufrufer berechnet, solange der Block noch im Cache liegt),
+ * peak_ahead der des folgenden Blocks (0 beim letzten). Die Hüllkurve
+ * nimmt das Maximum aus beiden und der abklingenden Historie, so ist
+ * der Gain schon unten, wenn ein lauter Block beginnt, und erholt
+ * sich danach über einige Sekunden. */
+void limiter_process(Limiter *lim, int16_t *dst, const float *src,
+    size_t n, float peak, float peak_ahead
+) {
+    /* Zeitbasiertes Abklingen: gleiche Erholrate, egal ob die Blöcke
+     * Millisekunden oder Sekunden lang sind */
+    lim->env *= (float)pow(0.5, (double)n / (LIMITER_RELEASE * SAMPLE_RATE));
+    if (peak > lim->env) lim->env = peak;
+    if (peak_ahead > lim->env) lim->env = peak_ahead;
+    float target = limiter_gain_for_peak(lim->env);
+    /* Noch keine Historie: direkt auf dem Ziel starten, statt durch
+     * einen womöglich lauten ersten Block herunterzurampen */
+    if (!lim->primed) {
+        lim->gain = target;
+        lim->primed = 1;
+    }
+    limiter_quantize(dst, src, n, lim->gain, target);
+    lim->gain = target;
+}
+
+/* ==================================================================
+   STREAMING-SYNTHESE (Just-in-Time)
+   ================================================================== */
+/* Statt vor dem Öffnen des Fensters den ganzen Song zu rendern,
+ * synthetisiert ein Hintergrund-Thread chunkweise einige Sekunden vor
+ * dem Abspielcursor her. Da das Noten-Array nach Startzeit sortiert
+ * ist, ist das Intervall [0, t) final, sobald alle Noten mit
+ * start_time < t gerendert sind -- genau dann wird es quantisiert und
+ * über samples_ready freigegeben. Der Callback spielt nur freigegebene
+ * Samples und füllt sonst mit Stille auf.
+ *
+ * Der Preis: Die globale Normalisierung entfällt; stattdessen läuft
+ * der Streaming-Limiter mit einem Chunk Lookahead (die Quantisierung
+ * hinkt dem Mischen um einen Chunk hinterher). */
+#define STREAM_CHUNK_SECONDS 2.0
+#define STREAM_LEAD_SECONDS 15.0
+
+typedef struct {
+    AudioContext *ctx;
+    const NoteList *nl;     /* nach Startzeit sortiert */
+    float *mix_buf;
+    volatile int abort;     /* vom Hauptthread gesetzt beim Beenden */
+} StreamSynth;
+
+int stream_synth_worker(void *arg) {
+    StreamSynth *st = (StreamSynth *)arg;
+    AudioContext *ctx = st->ctx;
+    size_t total = ctx->total_samples;
+    size_t chunk = (size_t)(STREAM_CHUNK_SECONDS * SAMPLE_RATE);
+    size_t lead = (size_t)(STREAM_LEAD_SECONDS * SAMPLE_RATE);
+    size_t done = 0;        /* bereits quantisierte Samples */
+    size_t rendered = 0;    /* bereits fertig gemischte Samples */
+    size_t next_note = 0;
+    float prev_peak = 0.0f; /* Peak des Chunks [done, rendered) */
+    Limiter lim;
+    limiter_init(&lim);
+
+    while (done < total && !st->abort) {
+        if (rendered < total) {
+            size_t t1 = rendered + chunk;
+            if (t1 > total) t1 = total;
+            double t1_sec = (double)t1 / SAMPLE_RATE;
+
+            /* Alle Noten rendern, die vor dem Chunk-Ende beginnen;
+             * spätere Noten schreiben nie vor ihren Startpunkt. Der
+             * Scheduler-Scan läuft nur über das dichte start-Array. */
+            while (next_note < st->nl->count &&
+                   st->nl->start[next_note] < t1_sec) {
+                Note n = notelist_get(st->nl, next_note);
+                render_note(st->mix_buf, total, &n);
+                next_note++;
             }
 
-            /* Envelope */
-            double env = 1.0;
-            if (time < 0.05) env = time / 0.05;
-            else if (time > dur) env = 1.0 - ((time - dur) / release);
-            if (env < 0) env = 0;
+            float peak = peak_abs(st->mix_buf + rendered, t1 - rendered);
+
+            /* Der vorige Chunk ist final und hat jetzt seinen
+             * Lookahead; der frische wartet auf den nächsten Umlauf */
+            if (rendered > done) {
+                limiter_process(&lim, ctx->pcm_buffer + done,
+                    st->mix_buf + done, rendered - done, prev_peak, peak);
+                done = rendered;
+                ctx->samples_ready = done;
+            }
+            prev_peak = peak;
+            rendered = t1;
+        } else {
+            /* Letzter Chunk: nichts folgt mehr, Lookahead 0 */
+            limiter_process(&lim, ctx->pcm_buffer + done,
+                st->mix_buf + done, rendered - done, prev_peak, 0.0f);
+            done = rendered;
+            ctx->samples_ready = done;
+        }
 
-            mix_buf[start_s + t] += (float)(val * amp * env);
+        /* Nicht beliebig weit vor dem Abspielcursor herlaufen */
+        while (!st->abort && done < total &&
+               done > ctx->play_cursor + lead) {
+            SDL_Delay(50);
         }
     }
+    free(st->mix_buf);
+    st->mix_buf = NULL;
+    return 0;
+}
 
-    /* Normalisierung und Konvertierung zu int16 */
-    float max_val = 0.0f;
-    for (size_t i = 0; i < total_samples; i++)
-        if (fabs(mix_buf[i]) > max_val) max_val = fabsf(mix_buf[i]);
+/* Startet die Streaming-Synthese; gibt den Worker-Thread zurück
+ * (oder NULL, wenn bereits synchron gerendert wurde). */
+SDL_Thread* synthesize_streaming(
+    const NoteList *nl, double duration,
+    AudioContext *ctx, StreamSynth *st
+) {
+    size_t total_samples = (size_t)(duration * SAMPLE_RATE);
+    SDL_Thread *th;
 
-    float norm = (max_val > 0) ? (32000.0f / max_val) : 1.0f;
-    if (norm > 32000.0f) norm = 32000.0f;
+    ctx->total_samples = total_samples;
+    ctx->play_cursor = 0;
+    ctx->samples_ready = 0;
+    ctx->pcm_buffer = calloc(total_samples, sizeof(int16_t));
+    st->mix_buf = calloc(total_samples, sizeof(float));
+    if (!ctx->pcm_buffer || !st->mix_buf) {
+        fprintf(stderr, "Out of Memory (Audio).\n");
+        exit(1);
+    }
 
-    ctx->pcm_buffer = malloc(total_samples * sizeof(int16_t));
-    for (size_t i = 0; i < total_samples; i++) {
-        int32_t v = (int32_t)(mix_buf[i] * norm);
-        if(v > 32767) v = 32767;
-        if(v < -32768) v = -32768;
-        ctx->pcm_buffer[i] = (int16_t)v;
+    st->ctx = ctx;
+    st->nl = nl;
+    st->abort = 0;
+
+    wavetable_init();
+    drum_voice_init();
+    note_cache_init();
+
+    printf("Streaming-Synthese: %zu Noten (%.1f s)...\n", nl->count, duration);
+    th = SDL_CreateThread(stream_synth_worker, "stream-synth", st);
+    if (!th) {
+        /* Kein Thread möglich: synchron rendern wie früher */
+        stream_synth_worker(st);
     }
-    free(mix_buf);
+    return th;
 }
 
 /* ==================================================================
-   AUDIO-GENERIERUNG (Timidity Pipe - RAW PCM Mode)
+   AUDIO-GENERIERUNG (Timidity Pipe - RAW PCM Mode, gestreamt)
    ================================================================== */
-void generate_audio_with_timidity(const char *midifile, AudioContext *ctx) {
-    printf("Starte Timidity via Pipe (Raw PCM)...\n");
+/* Früher wurde die komplette Pipe in den RAM gelesen (Realloc-
+ * Verdopplung), nochmal in einen SDL_AudioCVT-Puffer kopiert und am
+ * Stück konvertiert -- drei Kopien des PCM gleichzeitig im Speicher,
+ * und Abspielen erst, wenn Timidity fertig war. Jetzt schiebt ein
+ * Hintergrund-Thread jede 4-KB-Leseportion durch einen
+ * SDL_AudioStream (Stereo 44.1k -> unser Mono-Format) direkt in den
+ * vorallokierten pcm_buffer und gibt sie über samples_ready frei;
+ * der Callback spielt los, sobald die ersten Samples da sind. */
+typedef struct {
+    AudioContext *ctx;
+    FILE *pipe;
+    SDL_AudioStream *stream;
+    size_t capacity;        /* Samples im vorallokierten pcm_buffer */
+    volatile int abort;
+} TimidityStream;
+
+/* Konvertierte Samples aus dem AudioStream in den pcm_buffer ziehen */
+void timidity_drain(TimidityStream *ts) {
+    AudioContext *ctx = ts->ctx;
+    int16_t outbuf[4096];
+    int got;
+    while ((got = SDL_AudioStreamGet(ts->stream, outbuf, sizeof(outbuf))) > 0) {
+        size_t samples = (size_t)got / sizeof(int16_t);
+        size_t ready = ctx->samples_ready;
+        if (ready + samples > ts->capacity) samples = ts->capacity - ready;
+        if (samples == 0) return; /* Schätzung zu klein: Überschuss verwerfen */
+        memcpy(ctx->pcm_buffer + ready, outbuf, samples * sizeof(int16_t));
+        ctx->samples_ready = ready + samples;
+    }
+}
+
+int timidity_stream_worker(void *arg) {
+    TimidityStream *ts = (TimidityStream *)arg;
+    uint8_t inbuf[4096];
+    size_t n;
+
+    while (!ts->abort && (n = fread(inbuf, 1, sizeof(inbuf), ts->pipe)) > 0) {
+        if (SDL_AudioStreamPut(ts->stream, inbuf, (int)n) != 0) break;
+        timidity_drain(ts);
+    }
+    SDL_AudioStreamFlush(ts->stream);
+    timidity_drain(ts);
+
+    /* pclose schließt das Leseende; ein noch laufender Timidity
+     * beendet sich dann über SIGPIPE */
+    pclose(ts->pipe);
+    SDL_FreeAudioStream(ts->stream);
+
+    if (ts->ctx->samples_ready == 0) {
+        fprintf(stderr, "FEHLER: Keine Daten von Timidity empfangen.\n");
+    }
+    /* Jetzt kennen wir die echte Länge */
+    ts->ctx->total_samples = ts->ctx->samples_ready;
+    printf("Audio von Timidity geladen (RAW): %zu Samples (%.2fs)\n",
+           ts->ctx->total_samples,
+           (double)ts->ctx->total_samples / SAMPLE_RATE);
+    return 0;
+}
+
+SDL_Thread* generate_audio_with_timidity(
+    const char *midifile, double expected_duration,
+    AudioContext *ctx, TimidityStream *ts
+) {
+    printf("Starte Timidity via Pipe (Raw PCM, gestreamt)...\n");
 
     char cmd[1024];
     /*
@@ -400,69 +1331,275 @@ void generate_audio_with_timidity(const char *midifile, AudioContext *ctx) {
         exit(1);
     }
 
-    /* 1. Pipe-Stream in RAM lesen */
-    size_t cap = 1024 * 1024;
-    size_t size = 0;
-    uint8_t *raw_data = malloc(cap);
-    if (!raw_data) { fprintf(stderr, "Out of Memory.\n"); exit(1); }
+    /* Timidity Output Default: S16, System-Endian, Stereo */
+    SDL_AudioStream *stream = SDL_NewAudioStream(AUDIO_S16SYS, 2, 44100,
+        AUDIO_FORMAT, AUDIO_CHANNELS, SAMPLE_RATE);
+    if (!stream) {
+        fprintf(stderr, "FEHLER: Konnte Audio-Converter nicht bauen: %s\n",
+            SDL_GetError());
+        exit(1);
+    }
 
-    uint8_t buf[4096];
-    size_t n;
-    while ((n = fread(buf, 1, sizeof(buf), pipe)) > 0) {
-        if (size + n > cap) {
-            cap *= 2;
-            raw_data = realloc(raw_data, cap);
-            if (!raw_data) { fprintf(stderr, "Out of Memory.\n"); exit(1); }
-        }
-        memcpy(raw_data + size, buf, n);
-        size += n;
+    /* Der Buffer bleibt für den Callback an fester Adresse; daher
+     * großzügig anhand der MIDI-Dauer vorallokieren (Timidity liefert
+     * gern etwas mehr, z.B. Hall-Ausklang) */
+    size_t capacity = (size_t)((expected_duration * 1.1 + 10.0) * SAMPLE_RATE);
+    ctx->pcm_buffer = calloc(capacity, sizeof(int16_t));
+    if (!ctx->pcm_buffer) { fprintf(stderr, "Out of Memory.\n"); exit(1); }
+    ctx->total_samples = capacity;
+    ctx->play_cursor = 0;
+    ctx->samples_ready = 0;
+
+    ts->ctx = ctx;
+    ts->pipe = pipe;
+    ts->stream = stream;
+    ts->capacity = capacity;
+    ts->abort = 0;
+
+    SDL_Thread *th = SDL_CreateThread(timidity_stream_worker, "timidity", ts);
+    if (!th) {
+        /* Kein Thread möglich: blockierend einlesen wie früher */
+        timidity_stream_worker(ts);
     }
-    pclose(pipe);
+    return th;
+}
 
-    if (size == 0) {
-        fprintf(stderr, "FEHLER: Keine Daten von Timidity empfangen.\n");
-        free(raw_data);
-        exit(1);
+/* ==================================================================
+   ECHTZEIT-MODUS (LIVE-MIDI)
+   ================================================================== */
+/* Mit -live liest ein Eingabe-Thread rohe MIDI-Bytes von einem
+ * Gerät (z.B. /dev/midi1) und schiebt Note-On/Off-Ereignisse über
+ * lock-freie SPSC-Ringe an den Audio-Callback und den Hauptthread.
+ * Der Callback mischt aus einem festen Stimmen-Pool (kein malloc im
+ * Audio-Pfad) mit denselben Wavetable-Oszillatoren wie die Synthese.
+ * Mit 256-Sample-Puffer liegt die Latenz Taste-zu-Ton bei rund 6 ms
+ * plus die ~1 ms Poll-Schleife des Eingabe-Threads. */
+#define LIVE_RING_SIZE 256      /* Potenz von 2 */
+#define LIVE_RING_MASK (LIVE_RING_SIZE - 1)
+#define LIVE_VOICES 64
+#define LIVE_BLOCK 128          /* Ereignis-Quantisierung: < 3 ms */
+#define LIVE_AUDIO_SAMPLES 256  /* SDL-Puffer: ~5.8 ms bei 44100 Hz */
+#define LIVE_DEFAULT_DEVICE "/dev/midi"
+
+typedef struct {
+    uint8_t on;       /* 1 = Note-On, 0 = Note-Off */
+    uint8_t key;
+    uint8_t velocity;
+    uint8_t channel;
+} LiveEvent;
+
+/* Ein Produzent, ein Konsument: head schreibt nur der Eingabe-Thread,
+ * tail nur der Leser. SDL_AtomicSet/Get sind volle Barrieren, das
+ * Event ist also sichtbar, bevor head weiterrückt. Die Indizes laufen
+ * frei und werden nur beim Zugriff maskiert. */
+typedef struct {
+    LiveEvent ev[LIVE_RING_SIZE];
+    SDL_atomic_t head;
+    SDL_atomic_t tail;
+} LiveRing;
+
+int live_ring_push(LiveRing *r, LiveEvent e) {
+    int head = SDL_AtomicGet(&r->head);
+    if (head - SDL_AtomicGet(&r->tail) >= LIVE_RING_SIZE)
+        return 0; /* voll: Ereignis verwerfen statt blockieren */
+    r->ev[head & LIVE_RING_MASK] = e;
+    SDL_AtomicSet(&r->head, head + 1);
+    return 1;
+}
+
+int live_ring_pop(LiveRing *r, LiveEvent *out) {
+    int tail = SDL_AtomicGet(&r->tail);
+    if (SDL_AtomicGet(&r->head) == tail) return 0;
+    *out = r->ev[tail & LIVE_RING_MASK];
+    SDL_AtomicSet(&r->tail, tail + 1);
+    return 1;
+}
+
+typedef struct {
+    int active;
+    int released;        /* Release-Phase läuft */
+    int key, channel;
+    double age;          /* Sekunden seit Note-On */
+    double released_at;  /* age beim Note-Off */
+    double hold_limit;   /* > 0: klingt von selbst aus (Drums) */
+    float amp;
+    uint32_t phase[4];
+    uint32_t phase_inc[4];
+    float osc_gain[4];
+    int num_osc;
+} LiveVoice;
+
+typedef struct {
+    LiveRing audio_ring;    /* Eingabe-Thread -> Audio-Callback */
+    LiveRing ui_ring;       /* Eingabe-Thread -> Hauptthread */
+    LiveVoice voices[LIVE_VOICES];
+    float mix[LIVE_BLOCK];
+    Limiter lim;            /* nur der Callback fasst ihn an */
+    const char *device;
+    volatile int abort;
+} LiveEngine;
+
+static LiveEngine live_engine;
+
+/* Oszillator-Aufbau wie in render_note_direct, nur ohne bekannte
+ * Dauer: die Hüllkurve läuft mit, bis das Note-Off eintrifft. */
+void live_note_on(LiveEngine *eng, LiveEvent e) {
+    LiveVoice *vc = NULL;
+    for (int v = 0; v < LIVE_VOICES; v++) {
+        if (!eng->voices[v].active) { vc = &eng->voices[v]; break; }
+    }
+    if (!vc) {
+        /* Pool voll: die älteste Stimme stehlen */
+        vc = &eng->voices[0];
+        for (int v = 1; v < LIVE_VOICES; v++)
+            if (eng->voices[v].age > vc->age) vc = &eng->voices[v];
     }
 
-    /*
-       2. Manuelle Konvertierung
-       Da wir Raw Data haben, müssen wir SDL sagen, was das Format ist.
-       Timidity Output Default: S16 (Signed 16 bit), System Endian, Stereo (2 Channels).
-    */
-    SDL_AudioCVT cvt;
-    int src_channels = 2; /* Timidity erzeugt Stereo */
-    int src_rate = 44100;
+    memset(vc, 0, sizeof(*vc));
+    vc->active = 1;
+    vc->key = e.key;
+    vc->channel = e.channel;
+    vc->amp = (float)((e.velocity / 127.0) * 0.3);
+
+    if (e.channel == 9) {
+        vc->phase_inc[0] = wavetable_phase_inc(100.0);
+        vc->osc_gain[0] = 1.0f;
+        vc->num_osc = 1;
+        vc->hold_limit = 0.05;
+    } else {
+        double freq = midi_to_freq(e.key);
+        for (int ov = 0; ov < NUM_OVERTONES; ov++) {
+            double h = freq * (ov + 1);
+            if (h < SAMPLE_RATE/2) {
+                vc->phase_inc[vc->num_osc] = wavetable_phase_inc(h);
+                vc->osc_gain[vc->num_osc] = (float)(overtones[ov] / 1.9);
+                vc->num_osc++;
+            }
+        }
+    }
+}
 
-    /* Wir bauen einen Konverter: Timidity Stereo -> Unser Mono Format */
-    if (SDL_BuildAudioCVT(&cvt, AUDIO_S16SYS, src_channels, src_rate,
-            AUDIO_FORMAT, AUDIO_CHANNELS, SAMPLE_RATE) < 0)
-    {
-        fprintf(stderr, "FEHLER: Konnte Audio-Converter nicht bauen: %s\n", SDL_GetError());
-        exit(1);
+void live_note_off(LiveEngine *eng, LiveEvent e) {
+    for (int v = 0; v < LIVE_VOICES; v++) {
+        LiveVoice *vc = &eng->voices[v];
+        if (vc->active && !vc->released &&
+            vc->key == e.key && vc->channel == e.channel) {
+            vc->released = 1;
+            vc->released_at = vc->age;
+            return;
+        }
     }
+}
 
-    /* Puffer für Konvertierung vorbereiten */
-    cvt.len = (int)size;
-    /* SDL benötigt Puffer mit Puffergröße len * len_mult für In-Place-Konvertierung */
-    cvt.buf = malloc(cvt.len * cvt.len_mult);
+void live_voice_render(LiveVoice *vc, float *mix, int n) {
+    for (int t = 0; t < n; t++) {
+        double env = 1.0;
+        if (vc->age < ENV_ATTACK) env = vc->age / ENV_ATTACK;
 
-    /* Rohdaten in den Konverter-Puffer kopieren */
-    memcpy(cvt.buf, raw_data, size);
+        if (!vc->released && vc->hold_limit > 0 &&
+            vc->age >= vc->hold_limit) {
+            vc->released = 1;
+            vc->released_at = vc->age;
+        }
+        if (vc->released) {
+            double rel = (vc->age - vc->released_at) / ENV_RELEASE;
+            if (rel >= 1.0) { vc->active = 0; return; }
+            env *= 1.0 - rel;
+        }
 
-    /* Konvertieren */
-    SDL_ConvertAudio(&cvt);
+        double val = 0.0;
+        for (int k = 0; k < vc->num_osc; k++) {
+            val += vc->osc_gain[k] * wavetable_sample(vc->phase[k]);
+            vc->phase[k] += vc->phase_inc[k];
+        }
+        mix[t] += (float)(val * vc->amp * env);
+        vc->age += 1.0 / SAMPLE_RATE;
+    }
+}
 
-    /* Daten in den AudioContext übernehmen */
-    ctx->total_samples = cvt.len_cvt / sizeof(int16_t);
-    ctx->pcm_buffer = (int16_t*)cvt.buf; /* Konvertierten Puffer übernehmen */
-    ctx->play_cursor = 0;
+/* Rendert blockweise; Ereignisse werden an Blockgrenzen übernommen,
+ * bei LIVE_BLOCK Samples also auf unter 3 ms genau. */
+void live_audio_callback(void *userdata, Uint8 *stream, int len) {
+    LiveEngine *eng = (LiveEngine *)userdata;
+    int16_t *out = (int16_t *)stream;
+    int samples = len / (int)sizeof(int16_t);
+    int done = 0;
+    LiveEvent e;
+
+    while (done < samples) {
+        int block = samples - done;
+        if (block > LIVE_BLOCK) block = LIVE_BLOCK;
+
+        while (live_ring_pop(&eng->audio_ring, &e)) {
+            if (e.on) live_note_on(eng, e);
+            else live_note_off(eng, e);
+        }
 
-    /* Cleanup */
-    free(raw_data); /* Den ursprünglichen Roh-Puffer brauchen wir nicht mehr */
+        memset(eng->mix, 0, block * sizeof(float));
+        for (int v = 0; v < LIVE_VOICES; v++) {
+            if (eng->voices[v].active)
+                live_voice_render(&eng->voices[v], eng->mix, block);
+        }
+        /* Limiter ohne Lookahead -- in Echtzeit gibt es keinen Blick
+         * nach vorn, aber das Soft-Knee fängt Akkord-Spitzen ab */
+        limiter_process(&eng->lim, out + done, eng->mix, (size_t)block,
+            peak_abs(eng->mix, (size_t)block), 0.0f);
+        done += block;
+    }
+}
 
-    printf("Audio von Timidity geladen (RAW): %zu Samples (%.2fs)\n",
-           ctx->total_samples, (double)ctx->total_samples / SAMPLE_RATE);
+/* Liest rohe MIDI-Bytes vom Gerät (non-blocking, 1-ms-Poll) und
+ * parst sie inklusive Running Status. Nur Note-On/Off landet in den
+ * Ringen; Echtzeit-Bytes (>= 0xF8) dürfen mitten in einer Nachricht
+ * auftauchen und werden übersprungen. */
+int live_input_worker(void *arg) {
+    LiveEngine *eng = (LiveEngine *)arg;
+    uint8_t status = 0;
+    uint8_t data[2];
+    int need = 0, have = 0;
+
+    int fd = open(eng->device, O_RDONLY | O_NONBLOCK);
+    if (fd < 0) {
+        fprintf(stderr, "Live: Kann MIDI-Gerät %s nicht öffnen.\n",
+            eng->device);
+        return 1;
+    }
+
+    while (!eng->abort) {
+        uint8_t b;
+        ssize_t n = read(fd, &b, 1);
+        if (n <= 0) { SDL_Delay(1); continue; }
+
+        if (b >= 0xF8) continue;
+        if (b & 0x80) {
+            status = b;
+            have = 0;
+            switch (status & 0xF0) {
+                case 0xC0: case 0xD0: need = 1; break;
+                default: need = 2; break;
+            }
+            continue;
+        }
+        if (!status) continue; /* Datenbyte ohne Status: Müll */
+
+        data[have++] = b;
+        if (have < need) continue;
+        have = 0; /* Running Status: Status bleibt für Folgebytes aktiv */
+
+        uint8_t cmd = status & 0xF0;
+        if (cmd == 0x90 || cmd == 0x80) {
+            LiveEvent e;
+            /* Note-On mit Velocity 0 ist per Konvention ein Note-Off */
+            e.on = (cmd == 0x90 && data[1] > 0) ? 1 : 0;
+            e.key = data[0];
+            e.velocity = data[1];
+            e.channel = (uint8_t)(status & 0x0F);
+            live_ring_push(&eng->audio_ring, e);
+            live_ring_push(&eng->ui_ring, e);
+        }
+    }
+    close(fd);
+    return 0;
 }
 
 /* ==================================================================
@@ -472,10 +1609,36 @@ void generate_audio_with_timidity(const char *midifile, AudioContext *ctx) {
 void audio_callback(void *userdata, Uint8 *stream, int len) {
     AudioContext *ctx = (AudioContext *)userdata;
     int samples_needed = len / sizeof(int16_t);
-    int samples_left = ctx->total_samples - ctx->play_cursor;
+
+    /* Erst die Transport-Kommandos aus dem Ring anwenden; danach
+     * gehört der Cursor für den Rest des Callbacks uns allein */
+    TransportCmd cmd;
+    while (transport_pop(&ctx->transport, &cmd)) {
+        switch (cmd.type) {
+            case TC_SEEK:   ctx->play_cursor = cmd.cursor; break;
+            case TC_PAUSE:  ctx->cb_paused = 1; break;
+            case TC_RESUME: ctx->cb_paused = 0; break;
+        }
+    }
+    SDL_AtomicSet(&ctx->pub_cursor, (int)ctx->play_cursor);
+
+    /* Pausiert: Stille ausgeben, aber weiterlaufen, damit der Ring
+     * konsumiert wird und die Position publiziert bleibt */
+    if (ctx->cb_paused) {
+        memset(stream, 0, len);
+        return;
+    }
+
+    /* Nur bis zum Wasserstand der Synthese lesen; der Rest wird mit
+     * Stille gefüllt, bis der Hintergrund-Thread nachgeliefert hat */
+    size_t ready = ctx->samples_ready;
+    int samples_left = (ctx->play_cursor < ready)
+        ? (int)(ready - ctx->play_cursor) : 0;
 
     if (samples_left <= 0) {
         memset(stream, 0, len);
+        /* Nur als Underrun zählen, wenn der Song noch nicht vorbei ist */
+        if (ctx->play_cursor < ctx->total_samples) ctx->underruns++;
         return;
     }
 
@@ -483,9 +1646,11 @@ void audio_callback(void *userdata, Uint8 *stream, int len) {
     memcpy(stream, &ctx->pcm_buffer[ctx->play_cursor], to_copy * sizeof(int16_t));
 
     ctx->play_cursor += to_copy;
+    SDL_AtomicSet(&ctx->pub_cursor, (int)ctx->play_cursor);
 
     if (to_copy < samples_needed) {
         memset(stream + to_copy * sizeof(int16_t), 0, (samples_needed - to_copy) * sizeof(int16_t));
+        if (ctx->play_cursor < ctx->total_samples) ctx->underruns++;
     }
 }
 
@@ -578,6 +1743,111 @@ void RenderFillRoundedRect(SDL_Renderer *renderer, int x, int y, int w, int h, i
     }
 }
 
+/* ==================================================================
+   BATCHED RENDERING (Rounded-Rect-Textur)
+   ================================================================== */
+/* RenderFillRoundedRect feuert pro Ecke einen SDL_RenderDrawLine je
+ * Scanline ab -- bei dichten Passagen hunderte Draw-Calls pro Note.
+ * Stattdessen wird die Form einmal als weiße Textur vorgerendert und
+ * pro Note als getönte 9-Slice-Kopie gezeichnet (Ecken unskaliert,
+ * Kanten und Mitte gestreckt), die SDL intern batchen kann. */
+#define RRECT_TEX_RADIUS 8
+
+static SDL_Texture *rrect_tex = NULL;
+
+/* Weißes Rounded-Rect in eine Target-Textur rendern; NULL, wenn der
+ * Renderer keine Target-Texturen kann (dann greift der alte Pfad). */
+SDL_Texture* create_rounded_rect_texture(SDL_Renderer *rend) {
+    int s = 2 * RRECT_TEX_RADIUS + 2;
+    SDL_Texture *tex = SDL_CreateTexture(rend, SDL_PIXELFORMAT_RGBA8888,
+        SDL_TEXTUREACCESS_TARGET, s, s);
+    if (!tex) return NULL;
+    if (SDL_SetRenderTarget(rend, tex) != 0) {
+        SDL_DestroyTexture(tex);
+        return NULL;
+    }
+    SDL_SetRenderDrawBlendMode(rend, SDL_BLENDMODE_NONE);
+    SDL_SetRenderDrawColor(rend, 0, 0, 0, 0);
+    SDL_RenderClear(rend);
+    SDL_SetRenderDrawColor(rend, 255, 255, 255, 255);
+    RenderFillRoundedRect(rend, 0, 0, s, s, RRECT_TEX_RADIUS, CORNER_ALL);
+    SDL_SetRenderTarget(rend, NULL);
+    SDL_SetTextureBlendMode(tex, SDL_BLENDMODE_BLEND);
+    return tex;
+}
+
+/* Zeichnet ein gefülltes Rounded-Rect in der gegebenen Farbe über die
+ * vorgerenderte Textur; nicht gerundete Ecken beziehen ihren Ausschnitt
+ * aus der voll deckenden Texturmitte. */
+void draw_rounded_rect(SDL_Renderer *rend, int x, int y, int w, int h,
+    int r, int corners, SDL_Color c
+) {
+    if (!rrect_tex) {
+        SDL_SetRenderDrawColor(rend, c.r, c.g, c.b, 255);
+        RenderFillRoundedRect(rend, x, y, w, h, r, corners);
+        return;
+    }
+
+    const int R = RRECT_TEX_RADIUS;
+    const int S = 2 * R + 2;
+    int cs = r; /* Eckgröße auf dem Schirm */
+    if (cs * 2 > w) cs = w / 2;
+    if (cs * 2 > h) cs = h / 2;
+
+    SDL_SetTextureColorMod(rrect_tex, c.r, c.g, c.b);
+
+    SDL_Rect src_mid = {R, R, 2, 2};
+    SDL_Rect src, dst;
+
+    /* Ecken (gerundet aus der Textur-Ecke, sonst aus der Mitte) */
+    if (cs > 0) {
+        dst.w = cs; dst.h = cs;
+
+        src = (corners & CORNER_TL) ? (SDL_Rect){0, 0, R, R} : src_mid;
+        dst.x = x; dst.y = y;
+        SDL_RenderCopy(rend, rrect_tex, &src, &dst);
+
+        src = (corners & CORNER_TR) ? (SDL_Rect){S - R, 0, R, R} : src_mid;
+        dst.x = x + w - cs;
+        SDL_RenderCopy(rend, rrect_tex, &src, &dst);
+
+        src = (corners & CORNER_BL) ? (SDL_Rect){0, S - R, R, R} : src_mid;
+        dst.x = x; dst.y = y + h - cs;
+        SDL_RenderCopy(rend, rrect_tex, &src, &dst);
+
+        src = (corners & CORNER_BR) ? (SDL_Rect){S - R, S - R, R, R} : src_mid;
+        dst.x = x + w - cs;
+        SDL_RenderCopy(rend, rrect_tex, &src, &dst);
+    }
+
+    /* Kanten */
+    if (w - 2 * cs > 0 && cs > 0) {
+        src = (SDL_Rect){R, 0, 2, R};
+        dst = (SDL_Rect){x + cs, y, w - 2 * cs, cs};
+        SDL_RenderCopy(rend, rrect_tex, &src, &dst);
+        src = (SDL_Rect){R, S - R, 2, R};
+        dst.y = y + h - cs;
+        SDL_RenderCopy(rend, rrect_tex, &src, &dst);
+    }
+    if (h - 2 * cs > 0 && cs > 0) {
+        src = (SDL_Rect){0, R, R, 2};
+        dst = (SDL_Rect){x, y + cs, cs, h - 2 * cs};
+        SDL_RenderCopy(rend, rrect_tex, &src, &dst);
+        src = (SDL_Rect){S - R, R, R, 2};
+        dst.x = x + w - cs;
+        SDL_RenderCopy(rend, rrect_tex, &src, &dst);
+    }
+
+    /* Mitte */
+    if (w - 2 * cs > 0 && h - 2 * cs > 0) {
+        dst = (SDL_Rect){x + cs, y + cs, w - 2 * cs, h - 2 * cs};
+        SDL_RenderCopy(rend, rrect_tex, &src_mid, &dst);
+    }
+}
+
+/* Fenstergröße der Frametime-Historie fürs Performance-HUD */
+#define HUD_HISTORY 120
+
 /* Vergleichsfunktion für qsort: Sortieren nach Startzeit */
 int compare_notes_start(const void *a, const void *b) {
     const Note *na = (const Note *)a;
@@ -587,10 +1857,154 @@ int compare_notes_start(const void *a, const void *b) {
     return 0;
 }
 
+/* ==================================================================
+   RADIX-SORT FÜR NOTEN
+   ================================================================== */
+/* Bei Black-MIDI-Dateien mit Millionen Noten wird der qsort nach
+ * Startzeit zum Stillstand: ein indirekter Comparator-Aufruf pro
+ * Vergleich, single-threaded. Stattdessen ein LSD-Radix-Sort über den
+ * 64-Bit-Schlüssel: das IEEE-Bitmuster einer nichtnegativen double
+ * ist monoton zu ihrem Wert, die Startzeiten sind also direkt als
+ * uint64 sortierbar. Sortiert werden (Key, Index)-Paare, die Noten
+ * werden am Ende in einem Pass permutiert, statt 40-Byte-Structs acht
+ * Mal zu bewegen. Histogramm und Scatter jedes Passes laufen auf
+ * Chunks parallel; die Thread-Offsets aus der Präfix-Summe halten den
+ * Sort stabil. Passes, in denen alle Keys dasselbe Byte tragen (bei
+ * kurzen Songs die oberen), werden übersprungen.
+ *
+ * Die Events brauchen keinen Radix-Sort mehr: seit dem k-Wege-Merge
+ * im libmidicore-Parser wird dort gar nicht mehr global sortiert. */
+#define RADIX_BUCKETS 256
+#define RADIX_MIN_NOTES 32768 /* darunter gewinnt qsort */
+
+typedef struct {
+    uint64_t key;
+    size_t idx;
+} RadixRef;
+
+typedef struct {
+    const RadixRef *src;
+    RadixRef *dst;
+    size_t begin, end;
+    int shift;
+    /* Phase 1: Bucket-Zähler dieses Chunks; nach der Präfix-Summe
+     * die Schreib-Offsets für Phase 2 */
+    size_t hist[RADIX_BUCKETS];
+} RadixJob;
+
+int radix_hist_worker(void *arg) {
+    RadixJob *job = (RadixJob *)arg;
+    memset(job->hist, 0, sizeof(job->hist));
+    for (size_t i = job->begin; i < job->end; i++)
+        job->hist[(job->src[i].key >> job->shift) & 0xFF]++;
+    return 0;
+}
+
+int radix_scatter_worker(void *arg) {
+    RadixJob *job = (RadixJob *)arg;
+    for (size_t i = job->begin; i < job->end; i++) {
+        size_t b = (job->src[i].key >> job->shift) & 0xFF;
+        job->dst[job->hist[b]++] = job->src[i];
+    }
+    return 0;
+}
+
+/* Führt eine Phase auf allen Chunks aus; Chunk 0 übernimmt der
+ * Hauptthread, gescheiterte Thread-Starts laufen inline. */
+void radix_run_phase(int (*fn)(void *), RadixJob *jobs, int num_threads) {
+    SDL_Thread *threads[MAX_SYNTH_THREADS];
+    for (int i = 1; i < num_threads; i++) {
+        threads[i] = SDL_CreateThread(fn, "radix", &jobs[i]);
+        if (!threads[i]) fn(&jobs[i]);
+    }
+    fn(&jobs[0]);
+    for (int i = 1; i < num_threads; i++)
+        if (threads[i]) SDL_WaitThread(threads[i], NULL);
+}
+
+/* Sortiert die Referenzen stabil nach key; b ist ein Scratch-Buffer
+ * gleicher Größe. Das Ergebnis liegt am Ende wieder in a. */
+void radix_sort_refs(RadixRef *a, RadixRef *b, size_t n, int num_threads) {
+    RadixJob jobs[MAX_SYNTH_THREADS];
+    RadixRef *src = a, *dst = b;
+
+    for (int pass = 0; pass < 8; pass++) {
+        int shift = pass * 8;
+        for (int t = 0; t < num_threads; t++) {
+            jobs[t].src = src;
+            jobs[t].dst = dst;
+            jobs[t].begin = n * (size_t)t / num_threads;
+            jobs[t].end = n * ((size_t)t + 1) / num_threads;
+            jobs[t].shift = shift;
+        }
+        radix_run_phase(radix_hist_worker, jobs, num_threads);
+
+        /* Liegen alle Keys im selben Bucket, ändert der Pass nichts */
+        int occupied = 0;
+        for (int bkt = 0; bkt < RADIX_BUCKETS; bkt++) {
+            size_t cnt = 0;
+            for (int t = 0; t < num_threads; t++) cnt += jobs[t].hist[bkt];
+            if (cnt > 0) occupied++;
+        }
+        if (occupied <= 1) continue;
+
+        /* Präfix-Summe über (Bucket, Chunk): verwandelt die Zähler in
+         * die stabilen Schreib-Offsets der einzelnen Chunks */
+        size_t total = 0;
+        for (int bkt = 0; bkt < RADIX_BUCKETS; bkt++) {
+            for (int t = 0; t < num_threads; t++) {
+                size_t c = jobs[t].hist[bkt];
+                jobs[t].hist[bkt] = total;
+                total += c;
+            }
+        }
+
+        radix_run_phase(radix_scatter_worker, jobs, num_threads);
+        RadixRef *tmp = src; src = dst; dst = tmp;
+    }
+
+    if (src != a) memcpy(a, src, n * sizeof(RadixRef));
+}
+
+/* Ersetzt qsort(compare_notes_start) auf großen Arrays */
+void sort_notes_by_start(Note *notes, size_t count) {
+    if (count < RADIX_MIN_NOTES) {
+        qsort(notes, count, sizeof(Note), compare_notes_start);
+        return;
+    }
+
+    RadixRef *a = malloc(count * sizeof(RadixRef));
+    RadixRef *b = malloc(count * sizeof(RadixRef));
+    Note *out = malloc(count * sizeof(Note));
+    if (!a || !b || !out) {
+        free(a); free(b); free(out);
+        qsort(notes, count, sizeof(Note), compare_notes_start);
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        uint64_t key;
+        memcpy(&key, &notes[i].start_time, sizeof(key));
+        a[i].key = key;
+        a[i].idx = i;
+    }
+
+    radix_sort_refs(a, b, count, synth_thread_count(count));
+
+    for (size_t i = 0; i < count; i++)
+        out[i] = notes[a[i].idx];
+    memcpy(notes, out, count * sizeof(Note));
+
+    free(a);
+    free(b);
+    free(out);
+}
+
 typedef struct {
     /* Zustand */
     int running;
     int paused;
+    int live; /* -live: eigener Callback ohne Transport-Ring */
     Uint64 pause_start_counter;
     Uint64 start_counter;
     Uint64 frequency;
@@ -604,12 +2018,39 @@ typedef struct {
     SDL_AudioDeviceID dev;
     AudioContext ctx;
     size_t note_count;
+
+    /* Sweep-Cursor für render_notes: Index der ersten Note, die noch
+     * sichtbar sein kann. Läuft mit der Zeit monoton mit und wird nach
+     * einem Sprung rückwärts per Binärsuche neu aufgesetzt. */
+    size_t render_cursor;
+    int render_cursor_valid;
+    double last_render_time;
+    double max_note_duration; /* für die konservative Binärsuche */
+
+    /* Damage-Tracking: Events machen die Szene dirty; im pausierten
+     * Zustand wird ohne Damage nur mit ~2 Hz neu gezeichnet */
+    int scene_dirty;
+    double last_draw_time;
+
+    /* Cache-Textur der Ruhe-Klaviatur (neu bei Größenänderung) */
+    SDL_Texture *kb_tex;
+    int kb_tex_w, kb_tex_h;
+
+    /* Performance-HUD (Taste H): Timings des letzten Frames, Zähler
+     * aus render_notes und eine rollende Frametime-Historie */
+    int hud_visible;
+    double hud_t_input, hud_t_notes, hud_t_keys, hud_t_present;
+    size_t hud_notes_iterated, hud_notes_drawn;
+    float hud_frame_ms[HUD_HISTORY];
+    int hud_frame_pos;
 } Env;
 
 void handle_input(Env *env) {
     SDL_Event ev;
     Uint64 now_counter = SDL_GetPerformanceCounter();
     while (SDL_PollEvent(&ev)) {
+        /* Jedes Event kann das Bild ändern (Taste, Resize, Expose) */
+        env->scene_dirty = 1;
         if (ev.type == SDL_QUIT) env->running = 0;
         else if (ev.type == SDL_KEYDOWN) {
             switch (ev.key.keysym.sym) {
@@ -621,13 +2062,19 @@ void handle_input(Env *env) {
                     env->paused = !env->paused;
                     if (env->paused) {
                         env->pause_start_counter = now_counter;
-                        SDL_PauseAudioDevice(env->dev, 1); /* Audio pausieren */
+                        /* Pause als Kommando an den Callback: der läuft
+                         * weiter (Stille) und konsumiert den Ring. Im
+                         * Live-Modus gibt es keinen Ring, da wird das
+                         * Gerät direkt angehalten. */
+                        if (env->live) SDL_PauseAudioDevice(env->dev, 1);
+                        else transport_send(&env->ctx, TC_PAUSE, 0);
                     } else {
                         /* Die Zeit, die wir pausiert waren, auf den Start-Counter addieren,
                            damit der Song nicht visuell nach vorne springt */
                         Uint64 paused_duration = now_counter - env->pause_start_counter;
                         env->start_counter += paused_duration;
-                        SDL_PauseAudioDevice(env->dev, 0); /* Audio fortsetzen */
+                        if (env->live) SDL_PauseAudioDevice(env->dev, 0);
+                        else transport_send(&env->ctx, TC_RESUME, 0);
                     }
                     break;
                 case SDLK_j: /* Zurück (-10s) */
@@ -695,10 +2142,16 @@ void handle_input(Env *env) {
                                 new_cursor = 0;
                         }
 
-                        /* Atomares Update des Cursors (volatile) */
-                        env->ctx.play_cursor = (size_t)new_cursor;
+                        /* Sprung als Kommando an den Callback; der
+                         * Cursor selbst wird hier nicht mehr angefasst */
+                        if (!env->live)
+                            transport_send(&env->ctx, TC_SEEK,
+                                (size_t)new_cursor);
                     }
                     break;
+                case SDLK_h: /* Performance-HUD ein/aus */
+                    env->hud_visible = !env->hud_visible;
+                    break;
                 case SDLK_f:
                     if (env->fullscreen) {
                         SDL_SetWindowFullscreen(env->win, 0);
@@ -712,140 +2165,613 @@ void handle_input(Env *env) {
     }
 }
 
-void render_keyboard(SDL_Renderer *rend, Env *env,
-    int w, int note_area_h, int keyboard_height
+/* Eine weiße bzw. schwarze Taste in Ruhe- oder Aktivfarbe */
+void draw_white_key(SDL_Renderer *rend, Env *env, int m,
+    int y, int keyboard_height
 ) {
-    /* 1. Weiße Tasten */
-    for (int m = MIN_MIDI; m <= MAX_MIDI; m++) {
-        if (!is_black_key(m)) {
-            float x, width; int bk;
-            get_key_geometry(m, (float)w, &x, &width, &bk);
-
-            SDL_Color c = {220, 220, 220, 255};
-            if (env->active_keys[m]) {
-                /* Mix mit Notenfarbe */
-                c.r = (env->active_colors[m].r + 255) / 2;
-                c.g = (env->active_colors[m].g + 255) / 2;
-                c.b = (env->active_colors[m].b + 255) / 2;
-            }
+    SDL_Color c = {220, 220, 220, 255};
+    if (env && env->active_keys[m]) {
+        /* Mix mit Notenfarbe */
+        c.r = (env->active_colors[m].r + 255) / 2;
+        c.g = (env->active_colors[m].g + 255) / 2;
+        c.b = (env->active_colors[m].b + 255) / 2;
+    }
+    draw_rounded_rect(rend, (int)key_geom[m].x, y,
+        (int)key_geom[m].w - 1, keyboard_height, 5,
+        CORNER_BL | CORNER_BR, c);
+}
 
-            SDL_SetRenderDrawColor(rend, c.r, c.g, c.b, 255);
-            RenderFillRoundedRect(rend, (int)x, note_area_h,
-                (int)width - 1, keyboard_height, 5,
-                CORNER_BL | CORNER_BR);
-        }
+void draw_black_key(SDL_Renderer *rend, Env *env, int m,
+    int y, int keyboard_height
+) {
+    SDL_Color c = {20, 20, 20, 255};
+    if (env && env->active_keys[m]) {
+        c.r = (env->active_colors[m].r + 100) / 2;
+        c.g = (env->active_colors[m].g + 100) / 2;
+        c.b = (env->active_colors[m].b + 100) / 2;
     }
+    draw_rounded_rect(rend, (int)key_geom[m].x, y, (int)key_geom[m].w,
+        (int)(keyboard_height * 0.65), 3,
+        CORNER_BL | CORNER_BR, c);
+}
+
+/* Alle 88 Tasten direkt zeichnen (Aufbau der Cache-Textur bzw.
+ * Fallback ohne Target-Texturen); env == NULL heißt alles in Ruhe */
+void render_keyboard_direct(SDL_Renderer *rend, Env *env,
+    int note_area_h, int keyboard_height
+) {
+    /* 1. Weiße Tasten */
+    for (int m = MIN_MIDI; m <= MAX_MIDI; m++)
+        if (!key_geom[m].is_black)
+            draw_white_key(rend, env, m, note_area_h, keyboard_height);
     /* 2. Schwarze Tasten (oben drüber) */
-    for (int m = MIN_MIDI; m <= MAX_MIDI; m++) {
-        if (is_black_key(m)) {
-            float x, width; int bk;
-            get_key_geometry(m, (float)w, &x, &width, &bk);
-
-            SDL_Color c = {20, 20, 20, 255};
-            if (env->active_keys[m]) {
-                c.r = (env->active_colors[m].r + 100) / 2;
-                c.g = (env->active_colors[m].g + 100) / 2;
-                c.b = (env->active_colors[m].b + 100) / 2;
-            }
+    for (int m = MIN_MIDI; m <= MAX_MIDI; m++)
+        if (key_geom[m].is_black)
+            draw_black_key(rend, env, m, note_area_h, keyboard_height);
+}
 
-            SDL_SetRenderDrawColor(rend, c.r, c.g, c.b, 255);
-            RenderFillRoundedRect(rend,
-                (int)x, note_area_h, (int)width,
-                (int)(keyboard_height * 0.65), 3,
-                CORNER_BL | CORNER_BR);
-        }
+/* Baut die Textur mit der Klaviatur im Ruhezustand neu, wenn sich
+ * die Fenstergröße geändert hat. Schlägt die Target-Textur fehl,
+ * bleibt kb_tex NULL und es wird weiter direkt gezeichnet. */
+void keyboard_texture_update(SDL_Renderer *rend, Env *env,
+    int w, int keyboard_height
+) {
+    if (env->kb_tex && env->kb_tex_w == w && env->kb_tex_h == keyboard_height)
+        return;
+    if (env->kb_tex) { SDL_DestroyTexture(env->kb_tex); env->kb_tex = NULL; }
+    env->kb_tex_w = w;
+    env->kb_tex_h = keyboard_height;
+
+    SDL_Texture *tex = SDL_CreateTexture(rend, SDL_PIXELFORMAT_RGBA8888,
+        SDL_TEXTUREACCESS_TARGET, w, keyboard_height);
+    if (!tex) return;
+    SDL_SetRenderTarget(rend, tex);
+    SDL_SetRenderDrawColor(rend, 30, 30, 35, 255);
+    SDL_RenderClear(rend);
+    render_keyboard_direct(rend, NULL, 0, keyboard_height);
+    SDL_SetRenderTarget(rend, NULL);
+    env->kb_tex = tex;
+}
+
+/* Die Klaviatur ist bis auf die gerade gedrückten Tasten statisch:
+ * statt pro Frame 88 Rounded-Rects neu zu tessellieren, wird die
+ * Ruhe-Klaviatur aus der Cache-Textur kopiert und nur die aktiven
+ * Tasten werden darübergezeichnet. Schwarze Tasten überlappen ihre
+ * weißen Nachbarn und müssen nachgezogen werden, wenn einer davon
+ * aktiv ist. */
+void render_keyboard(SDL_Renderer *rend, Env *env,
+    int note_area_h, int keyboard_height
+) {
+    int w, h;
+    SDL_GetRendererOutputSize(rend, &w, &h);
+    keyboard_texture_update(rend, env, w, keyboard_height);
+
+    if (!env->kb_tex) {
+        render_keyboard_direct(rend, env, note_area_h, keyboard_height);
+        return;
+    }
+
+    SDL_Rect dst = {0, note_area_h, env->kb_tex_w, env->kb_tex_h};
+    SDL_RenderCopy(rend, env->kb_tex, NULL, &dst);
+
+    for (int m = MIN_MIDI; m <= MAX_MIDI; m++)
+        if (!key_geom[m].is_black && env->active_keys[m])
+            draw_white_key(rend, env, m, note_area_h, keyboard_height);
+    for (int m = MIN_MIDI; m <= MAX_MIDI; m++) {
+        if (!key_geom[m].is_black) continue;
+        int neighbor_active =
+            (m > MIN_MIDI && !key_geom[m - 1].is_black && env->active_keys[m - 1]) ||
+            (m < MAX_MIDI && !key_geom[m + 1].is_black && env->active_keys[m + 1]);
+        if (env->active_keys[m] || neighbor_active)
+            draw_black_key(rend, env, m, note_area_h, keyboard_height);
     }
 }
 
-void render_notes(SDL_Renderer *rend, Env *env, Note *notes,
-    int w, int note_area_h, double current_time, double lookahead_time
+void render_notes(SDL_Renderer *rend, Env *env, const NoteList *nl,
+    int note_area_h, double current_time, double lookahead_time
 ) {
-    for (size_t i = 0; i < env->note_count; i++) {
-        const Note *n = &notes[i];
+    /* Nach einem Rücksprung (oder beim ersten Frame) den Cursor per
+     * Binärsuche neu aufsetzen: Noten mit
+     *   start < current_time - 1.0 - max_note_duration
+     * sind garantiert vorbei und bleiben dauerhaft links vom Cursor. */
+    if (!env->render_cursor_valid || current_time < env->last_render_time) {
+        double limit = current_time - 1.0 - env->max_note_duration;
+        size_t lo = 0, hi = nl->count;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (nl->start[mid] < limit) lo = mid + 1;
+            else hi = mid;
+        }
+        env->render_cursor = lo;
+        env->render_cursor_valid = 1;
+    }
+    env->last_render_time = current_time;
+
+    /* Cursor vorschieben, solange die Präfix-Note endgültig vorbei ist.
+     * Damit iteriert der Frame nur noch über das sichtbare Fenster
+     * statt jedes Mal über das ganze Array von vorn. */
+    while (env->render_cursor < nl->count) {
+        size_t c = env->render_cursor;
+        if ((nl->start[c] + nl->duration[c]) < current_time - 1.0)
+            env->render_cursor++;
+        else break;
+    }
+
+    env->hud_notes_iterated = 0;
+    env->hud_notes_drawn = 0;
+
+    /* Der Sichtbarkeitstest liest nur die dichten start/duration-
+     * Arrays; key und color werden erst für gezeichnete Noten geholt */
+    for (size_t i = env->render_cursor; i < nl->count; i++) {
+        double start = nl->start[i];
+        double dur = nl->duration[i];
+        env->hud_notes_iterated++;
 
         /* Clipping: Nur Noten zeichnen, die im sichtbaren Bereich sind */
         /* Note ist sichtbar wenn: (start <= t + 5.0) UND (end >= t - 1.0) */
-        if (n->start_time > current_time + lookahead_time) break;
+        if (start > current_time + lookahead_time) break;
 
-        if ((n->start_time + n->duration) < current_time - 1.0) continue;
+        if ((start + dur) < current_time - 1.0) continue;
 
-        float time_diff = (float)(n->start_time - current_time);
+        float time_diff = (float)(start - current_time);
         float note_y = note_area_h - (time_diff * PIXELS_PER_SECOND);
-        float note_h = (float)(n->duration * PIXELS_PER_SECOND);
+        float note_h = (float)(dur * PIXELS_PER_SECOND);
         float draw_y = note_y - note_h;
+        int key = nl->key[i];
 
         /* Check ob Note "aktiv" ist (wird gerade gespielt) */
-        int is_playing = (current_time >= n->start_time &&
-            current_time < (n->start_time + n->duration));
+        int is_playing = (current_time >= start &&
+            current_time < (start + dur));
         if (is_playing) {
+            env->active_keys[key] = 1;
+            env->active_colors[key] = nl->color[i];
+        }
+
+        if (key >= MIN_MIDI && key <= MAX_MIDI) {
+            float x = key_geom[key].x;
+            float width = key_geom[key].w;
+
+            /* Farbe aufhellen wenn aktiv */
+            SDL_Color c = nl->color[i];
+            if(is_playing) {
+                c.r = (c.r > 195) ? 255 : c.r + 60;
+                c.g = (c.g > 195) ? 255 : c.g + 60;
+                c.b = (c.b > 195) ? 255 : c.b + 60;
+            }
+
+            draw_rounded_rect(rend, (int)x + 1, (int)draw_y,
+                (int)width - 2, (int)note_h, 4, CORNER_ALL, c);
+            env->hud_notes_drawn++;
+        }
+    }
+}
+
+/* Sichtbare Live-Noten: ein Ring der letzten Ereignisse. Gehaltene
+ * Noten wachsen von der Klaviatur nach oben, losgelassene scrollen
+ * mit fester Höhe weiter und geben ihren Slot frei, sobald sie oben
+ * aus dem Bild sind. velocity == 0 markiert einen freien Slot. */
+#define LIVE_MAX_NOTES 512
+
+static Note live_notes[LIVE_MAX_NOTES];
+static size_t live_note_head = 0;
+static int live_held[16][128]; /* Slot-Index+1 der gehaltenen Note */
+
+void live_drain_ui(LiveEngine *eng, double current_time) {
+    LiveEvent e;
+    while (live_ring_pop(&eng->ui_ring, &e)) {
+        if (e.on) {
+            size_t idx = live_note_head++ % LIVE_MAX_NOTES;
+            Note *n = &live_notes[idx];
+
+            /* Falls der wiederverwendete Slot noch als gehalten
+             * registriert ist, den Verweis austragen */
+            if (n->velocity > 0 && n->duration < 0 &&
+                live_held[n->channel][n->midi_key] == (int)idx + 1)
+                live_held[n->channel][n->midi_key] = 0;
+
+            n->start_time = current_time;
+            n->midi_key = e.key;
+            n->velocity = e.velocity;
+            n->channel = e.channel;
+            n->color = get_channel_color(e.channel);
+            if (e.channel == 9) {
+                n->duration = 0.05; /* Drums klingen von selbst aus */
+            } else {
+                n->duration = -1.0; /* -1 = wird gehalten */
+                live_held[e.channel][e.key] = (int)idx + 1;
+            }
+        } else {
+            int idx = live_held[e.channel][e.key];
+            if (idx) {
+                Note *n = &live_notes[idx - 1];
+                n->duration = current_time - n->start_time;
+                live_held[e.channel][e.key] = 0;
+            }
+        }
+    }
+}
+
+void render_live_notes(SDL_Renderer *rend, Env *env,
+    int note_area_h, double current_time
+) {
+    env->hud_notes_iterated = 0;
+    env->hud_notes_drawn = 0;
+
+    for (size_t i = 0; i < LIVE_MAX_NOTES; i++) {
+        Note *n = &live_notes[i];
+        if (n->velocity == 0) continue;
+        env->hud_notes_iterated++;
+
+        int held = (n->duration < 0);
+        double end = held ? current_time : n->start_time + n->duration;
+        float y_bottom = (float)(note_area_h -
+            (current_time - end) * PIXELS_PER_SECOND);
+        float note_h = (float)((end - n->start_time) * PIXELS_PER_SECOND);
+
+        if (y_bottom < 0.0f) { n->velocity = 0; continue; }
+        if (note_h < 2.0f) note_h = 2.0f;
+
+        if (held) {
             env->active_keys[n->midi_key] = 1;
             env->active_colors[n->midi_key] = n->color;
         }
 
         if (n->midi_key >= MIN_MIDI && n->midi_key <= MAX_MIDI) {
-            float x, width;
-            int is_bk;
-            get_key_geometry(n->midi_key, (float)w, &x, &width, &is_bk);
-
-            /* Farbe aufhellen wenn aktiv */
+            float x = key_geom[n->midi_key].x;
+            float width = key_geom[n->midi_key].w;
             SDL_Color c = n->color;
-            if(is_playing) {
+            if (held) {
                 c.r = (c.r > 195) ? 255 : c.r + 60;
                 c.g = (c.g > 195) ? 255 : c.g + 60;
                 c.b = (c.b > 195) ? 255 : c.b + 60;
             }
+            draw_rounded_rect(rend, (int)x + 1, (int)(y_bottom - note_h),
+                (int)width - 2, (int)note_h, 4, CORNER_ALL, c);
+            env->hud_notes_drawn++;
+        }
+    }
+}
+
+/* ==================================================================
+   PERFORMANCE-HUD
+   ================================================================== */
+/* Mit Taste H einblendbares Overlay: Frame-Timings aufgeteilt nach
+ * Stufen, Zähler aus dem Render-Pfad, Callback-Underruns, die Drift
+ * zwischen Audio-Cursor und visueller Uhr und ein rollendes
+ * Frametime-Histogramm für 99%-Spikes. Der Text kommt aus einer
+ * eingebetteten 5x7-Pixelschrift (spaltenweise, Bit 0 = oberste
+ * Zeile), damit keine Font-Bibliothek nötig ist. */
+#define HUD_SCALE 2
+#define HUD_HIST_FULL_MS 50.0f /* Vollausschlag eines Histogramm-Balkens */
+
+/* Zeichensatz: " 0123456789.:+-/%" gefolgt von A-Z */
+static const uint8_t hud_font[][5] = {
+    {0x00,0x00,0x00,0x00,0x00}, /*   */
+    {0x3E,0x51,0x49,0x45,0x3E}, /* 0 */
+    {0x00,0x42,0x7F,0x40,0x00}, /* 1 */
+    {0x42,0x61,0x51,0x49,0x46}, /* 2 */
+    {0x21,0x41,0x45,0x4B,0x31}, /* 3 */
+    {0x18,0x14,0x12,0x7F,0x10}, /* 4 */
+    {0x27,0x45,0x45,0x45,0x39}, /* 5 */
+    {0x3C,0x4A,0x49,0x49,0x30}, /* 6 */
+    {0x01,0x71,0x09,0x05,0x03}, /* 7 */
+    {0x36,0x49,0x49,0x49,0x36}, /* 8 */
+    {0x06,0x49,0x49,0x29,0x1E}, /* 9 */
+    {0x00,0x60,0x60,0x00,0x00}, /* . */
+    {0x00,0x36,0x36,0x00,0x00}, /* : */
+    {0x08,0x08,0x3E,0x08,0x08}, /* + */
+    {0x08,0x08,0x08,0x08,0x08}, /* - */
+    {0x20,0x10,0x08,0x04,0x02}, /* / */
+    {0x23,0x13,0x08,0x64,0x62}, /* % */
+    {0x7E,0x11,0x11,0x11,0x7E}, /* A */
+    {0x7F,0x49,0x49,0x49,0x36}, /* B */
+    {0x3E,0x41,0x41,0x41,0x22}, /* C */
+    {0x7F,0x41,0x41,0x22,0x1C}, /* D */
+    {0x7F,0x49,0x49,0x49,0x41}, /* E */
+    {0x7F,0x09,0x09,0x09,0x01}, /* F */
+    {0x3E,0x41,0x49,0x49,0x7A}, /* G */
+    {0x7F,0x08,0x08,0x08,0x7F}, /* H */
+    {0x00,0x41,0x7F,0x41,0x00}, /* I */
+    {0x20,0x40,0x41,0x3F,0x01}, /* J */
+    {0x7F,0x08,0x14,0x22,0x41}, /* K */
+    {0x7F,0x40,0x40,0x40,0x40}, /* L */
+    {0x7F,0x02,0x0C,0x02,0x7F}, /* M */
+    {0x7F,0x04,0x08,0x10,0x7F}, /* N */
+    {0x3E,0x41,0x41,0x41,0x3E}, /* O */
+    {0x7F,0x09,0x09,0x09,0x06}, /* P */
+    {0x3E,0x41,0x51,0x21,0x5E}, /* Q */
+    {0x7F,0x09,0x19,0x29,0x46}, /* R */
+    {0x46,0x49,0x49,0x49,0x31}, /* S */
+    {0x01,0x01,0x7F,0x01,0x01}, /* T */
+    {0x3F,0x40,0x40,0x40,0x3F}, /* U */
+    {0x1F,0x20,0x40,0x20,0x1F}, /* V */
+    {0x3F,0x40,0x38,0x40,0x3F}, /* W */
+    {0x63,0x14,0x08,0x14,0x63}, /* X */
+    {0x07,0x08,0x70,0x08,0x07}, /* Y */
+    {0x61,0x51,0x49,0x45,0x43}  /* Z */
+};
+
+int hud_glyph_index(char ch) {
+    static const char sym[] = " 0123456789.:+-/%";
+    if (ch >= 'a' && ch <= 'z') ch -= 32;
+    if (ch >= 'A' && ch <= 'Z') return 17 + (ch - 'A');
+    for (int i = 0; sym[i]; i++) if (sym[i] == ch) return i;
+    return 0;
+}
 
-            SDL_SetRenderDrawColor(rend, c.r, c.g, c.b, 255);
-            RenderFillRoundedRect(rend, (int)x + 1, (int)draw_y,
-                (int)width - 2, (int)note_h, 4, CORNER_ALL);
+/* Zeichnet einen String in der aktuellen Render-Farbe */
+void hud_draw_text(SDL_Renderer *rend, int x, int y, const char *s) {
+    for (; *s; s++, x += 6 * HUD_SCALE) {
+        const uint8_t *g = hud_font[hud_glyph_index(*s)];
+        for (int col = 0; col < 5; col++) {
+            for (int row = 0; row < 7; row++) {
+                if (g[col] & (1 << row)) {
+                    SDL_Rect px = {x + col * HUD_SCALE, y + row * HUD_SCALE,
+                                   HUD_SCALE, HUD_SCALE};
+                    SDL_RenderFillRect(rend, &px);
+                }
+            }
         }
     }
 }
 
+int hud_compare_float(const void *a, const void *b) {
+    float fa = *(const float *)a, fb = *(const float *)b;
+    return (fa > fb) - (fa < fb);
+}
+
+void hud_render(SDL_Renderer *rend, Env *env, double current_time) {
+    char line[128];
+    int y = 10;
+
+    SDL_SetRenderDrawBlendMode(rend, SDL_BLENDMODE_BLEND);
+    SDL_Rect bg = {4, 4, 640, 148};
+    SDL_SetRenderDrawColor(rend, 0, 0, 0, 180);
+    SDL_RenderFillRect(rend, &bg);
+
+    /* p99 über die Historie (kleine Kopie, Sortieren ist billig) */
+    float sorted[HUD_HISTORY];
+    memcpy(sorted, env->hud_frame_ms, sizeof(sorted));
+    qsort(sorted, HUD_HISTORY, sizeof(float), hud_compare_float);
+    float p99 = sorted[(HUD_HISTORY * 99) / 100];
+    float last = env->hud_frame_ms[
+        (env->hud_frame_pos + HUD_HISTORY - 1) % HUD_HISTORY];
+
+    SDL_SetRenderDrawColor(rend, 230, 230, 230, 255);
+    snprintf(line, sizeof(line), "FRAME %6.2f MS   P99 %6.2f MS", last, p99);
+    hud_draw_text(rend, 10, y, line); y += 18;
+
+    snprintf(line, sizeof(line),
+        "INPUT %5.2f  NOTEN %5.2f  TASTEN %5.2f  PRESENT %5.2f",
+        env->hud_t_input * 1000.0, env->hud_t_notes * 1000.0,
+        env->hud_t_keys * 1000.0, env->hud_t_present * 1000.0);
+    hud_draw_text(rend, 10, y, line); y += 18;
+
+    snprintf(line, sizeof(line), "NOTEN %zu ITERIERT / %zu GEZEICHNET",
+        env->hud_notes_iterated, env->hud_notes_drawn);
+    hud_draw_text(rend, 10, y, line); y += 18;
+
+    double drift_ms = (current_time -
+        (double)SDL_AtomicGet(&env->ctx.pub_cursor) / SAMPLE_RATE) * 1000.0;
+    snprintf(line, sizeof(line), "UNDERRUNS %zu   DRIFT %+7.1f MS",
+        (size_t)env->ctx.underruns, drift_ms);
+    hud_draw_text(rend, 10, y, line); y += 18;
+
+    /* Histogramm: ein Balken pro Frame, ältester links */
+    int hh = 48;
+    for (int i = 0; i < HUD_HISTORY; i++) {
+        float ms = env->hud_frame_ms[(env->hud_frame_pos + i) % HUD_HISTORY];
+        int bh = (int)(ms / HUD_HIST_FULL_MS * hh);
+        if (bh > hh) bh = hh;
+        if (bh < 1) bh = 1;
+        if (ms > 33.0f)      SDL_SetRenderDrawColor(rend, 230, 70, 70, 255);
+        else if (ms > 17.0f) SDL_SetRenderDrawColor(rend, 230, 200, 70, 255);
+        else                 SDL_SetRenderDrawColor(rend, 90, 200, 110, 255);
+        SDL_Rect bar = {10 + i * 5, y + hh - bh, 4, bh};
+        SDL_RenderFillRect(rend, &bar);
+    }
+}
+
+/* ==================================================================
+   BENCHMARK-MODUS (headless)
+   ================================================================== */
+double now_seconds(void) {
+    return (double)SDL_GetPerformanceCounter() /
+           (double)SDL_GetPerformanceFrequency();
+}
+
+/* Misst die einzelnen Stufen (Parsen, Konvertieren, Sortieren,
+ * Synthese) und einen Render-Loop auf einem Software-Renderer ohne
+ * Fenster. Ausgabe als "BENCH <stufe> ..."-Zeilen, damit Skripte sie
+ * einsammeln können. */
+int run_benchmark(const char *midifile) {
+    Env env;
+    memset(&env, 0, sizeof(env));
+
+    double t0 = now_seconds();
+    parse_midi(midifile);
+    double t1 = now_seconds();
+    printf("BENCH parse_midi    %8.3f s  (%zu Events)\n", t1 - t0, song.event_count);
+
+    double duration;
+    Note *notes = convert_to_notes(&env.note_count, &duration);
+    double t2 = now_seconds();
+    printf("BENCH convert       %8.3f s  (%zu Noten)\n", t2 - t1, env.note_count);
+
+    sort_notes_by_start(notes, env.note_count);
+    NoteList nl;
+    notelist_build(&nl, notes, env.note_count);
+    double t3 = now_seconds();
+    printf("BENCH sort_notes    %8.3f s  (inkl. SoA-Transponierung)\n", t3 - t2);
+
+    synthesize_to_ram(&nl, duration, &env.ctx);
+    double t4 = now_seconds();
+    printf("BENCH synth         %8.3f s  (%.1fx Echtzeit)\n",
+        t4 - t3, duration / (t4 - t3));
+
+    for (size_t i = 0; i < nl.count; i++) {
+        if (nl.duration[i] > env.max_note_duration)
+            env.max_note_duration = nl.duration[i];
+    }
+
+    /* Headless-Rendering: Software-Renderer auf einer Surface */
+    SDL_Surface *surf = SDL_CreateRGBSurfaceWithFormat(0,
+        WINDOW_WIDTH, WINDOW_HEIGHT, 32, SDL_PIXELFORMAT_RGBA8888);
+    SDL_Renderer *rend = surf ? SDL_CreateSoftwareRenderer(surf) : NULL;
+    if (rend) {
+        rrect_tex = create_rounded_rect_texture(rend);
+        update_key_geometry((float)WINDOW_WIDTH);
+
+        int keyboard_height = KEYBOARD_HEIGHT;
+        int note_area_h = WINDOW_HEIGHT - keyboard_height;
+        double lookahead_time = (double)note_area_h / PIXELS_PER_SECOND + 1.0;
+
+        /* Simulierte Frames mit 60 fps über den ganzen Song, gedeckelt */
+        long max_frames = (long)(duration * 60.0);
+        if (max_frames > 3600) max_frames = 3600;
+        if (max_frames < 1) max_frames = 1;
+
+        double t5 = now_seconds();
+        for (long fnum = 0; fnum < max_frames; fnum++) {
+            double sim_time = duration * fnum / max_frames;
+            SDL_SetRenderDrawColor(rend, 30, 30, 35, 255);
+            SDL_RenderClear(rend);
+            for (int i = 0; i < 128; i++) env.active_keys[i] = 0;
+            render_notes(rend, &env, &nl, note_area_h, sim_time, lookahead_time);
+            render_keyboard(rend, &env, note_area_h, keyboard_height);
+        }
+        double t6 = now_seconds();
+        printf("BENCH render        %8.3f s  (%ld Frames, %.3f ms/Frame)\n",
+            t6 - t5, max_frames, (t6 - t5) * 1000.0 / max_frames);
+
+        if (env.kb_tex) { SDL_DestroyTexture(env.kb_tex); env.kb_tex = NULL; }
+        if (rrect_tex) { SDL_DestroyTexture(rrect_tex); rrect_tex = NULL; }
+        SDL_DestroyRenderer(rend);
+    }
+    if (surf) SDL_FreeSurface(surf);
+
+    free(env.ctx.pcm_buffer);
+    notelist_free(&nl);
+    mc_song_free(&song);
+    note_cache_free();
+    drum_voice_free();
+    return 0;
+}
+
 int main(int argc, char **argv) {
     const char *midifile = NULL;
     int use_timidity = 0;
+    int prerender = 0;
+    int bench = 0;
+    int live = 0;
+    StreamSynth stream;
+    TimidityStream tstream;
+    SDL_Thread *synth_thread = NULL;
+    SDL_Thread *live_thread = NULL;
+    stream.abort = 0;
+    tstream.abort = 0;
     Env env;
-    env.fullscreen = 0;
+    memset(&env, 0, sizeof(env)); /* inkl. HUD-Zähler und -Historie */
 
     /* Argumente parsen */
+    live_engine.device = LIVE_DEFAULT_DEVICE;
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "-tm") == 0) {
             use_timidity = 1;
+        } else if (strcmp(argv[i], "-pre") == 0) {
+            prerender = 1;
+        } else if (strcmp(argv[i], "-bench") == 0) {
+            bench = 1;
+        } else if (strcmp(argv[i], "-live") == 0) {
+            live = 1;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                live_engine.device = argv[++i];
         } else if (argv[i][0] != '-') {
             midifile = argv[i];
         }
     }
 
-    if (!midifile) {
-        printf("Verwendung: %s <datei.mid> [-tm]\n", argv[0]);
-        printf("  -tm : Benutze 'timidity' für bessere Audioqualität\n");
+    if (!midifile && !live) {
+        printf("Verwendung: %s <datei.mid> [-tm] [-pre] [-bench]\n", argv[0]);
+        printf("            %s -live [gerät]\n", argv[0]);
+        printf("  -tm    : Benutze 'timidity' für bessere Audioqualität\n");
+        printf("  -pre   : Ganzen Song vorab rendern (mit Normalisierung)\n");
+        printf("  -bench : Stufen-Timings messen (ohne Fenster und Audio)\n");
+        printf("  -live  : Echtzeit-Eingabe von einem MIDI-Gerät (Standard: %s)\n",
+            LIVE_DEFAULT_DEVICE);
         return 1;
     }
 
-    /* 1. MIDI parsen */
-    uint16_t division;
-    parse_midi(midifile, &division);
-    double duration;
-    Note *notes = convert_to_notes(division, &env.note_count, &duration);
-    if (!notes) { printf("Keine Noten gefunden.\n"); return 1; }
-
-    /* Array nach Startzeit sortieren, damit das break bei
-     * start > limit im Render-Loop korrekt funktioniert;
-     * andernfalls kann es passieren, dass der Balken ein wenig zu spät
-     * auftaucht. Nämlich wird in der Funktion convert_to_notes
-     * eine Note erst dann in das Array geschrieben, wenn das
-     * Note-Off-Event im MIDI-Stream auftaucht (also wenn die Note zu
-     * Ende ist). Dadurch ist die Notenliste effektiv nach Endzeitpunkt
-     * sortiert, nicht nach Startzeitpunkt. */
-    qsort(notes, env.note_count, sizeof(Note), compare_notes_start);
-
-    /* 2. Audio synthetisieren */
-    if (use_timidity) {
+    if (bench) return run_benchmark(midifile);
+
+    /* 1. MIDI parsen (im Live-Modus gibt es keine Datei).
+     * Vorher den Sidecar-Cache probieren: Treffer liefert das fertige
+     * PCM und die sortierten Noten per mmap, Parser und Synthese
+     * entfallen komplett. */
+    double duration = 0.0;
+    NoteList nl;
+    memset(&nl, 0, sizeof(nl));
+    int cache_hit = 0;
+    uint32_t sidecar_engine = use_timidity ?
+        SIDECAR_ENGINE_TIMIDITY : SIDECAR_ENGINE_INTERN;
+    if (!live)
+        cache_hit = sidecar_load(midifile, sidecar_engine,
+            &nl, &duration, &env.ctx);
+    if (!live && !cache_hit) {
+        parse_midi(midifile);
+        Note *notes = convert_to_notes(&env.note_count, &duration);
+        if (!notes) { printf("Keine Noten gefunden.\n"); return 1; }
+
+        /* Array nach Startzeit sortieren, damit das break bei
+         * start > limit im Render-Loop korrekt funktioniert;
+         * andernfalls kann es passieren, dass der Balken ein wenig zu spät
+         * auftaucht. Nämlich wird in der Funktion convert_to_notes
+         * eine Note erst dann in das Array geschrieben, wenn das
+         * Note-Off-Event im MIDI-Stream auftaucht (also wenn die Note zu
+         * Ende ist). Dadurch ist die Notenliste effektiv nach Endzeitpunkt
+         * sortiert, nicht nach Startzeitpunkt. */
+        sort_notes_by_start(notes, env.note_count);
+        notelist_build(&nl, notes, env.note_count);
+    }
+    env.note_count = nl.count;
+
+    /* Längste Notendauer für die Cursor-Binärsuche in render_notes */
+    env.render_cursor = 0;
+    env.render_cursor_valid = 0;
+    env.last_render_time = 0.0;
+    env.max_note_duration = 0.0;
+    for (size_t i = 0; i < nl.count; i++) {
+        if (nl.duration[i] > env.max_note_duration)
+            env.max_note_duration = nl.duration[i];
+    }
+
+    /* 2. Audio synthetisieren.
+     * Standard ist die Streaming-Synthese: Das Fenster öffnet sofort,
+     * der Sound wird im Hintergrund vor dem Cursor hergerendert.
+     * Im Live-Modus füttert stattdessen der Eingabe-Thread den
+     * Stimmen-Pool im Callback. */
+    if (live) {
+        wavetable_init();
+        limiter_init(&live_engine.lim);
+        live_thread = SDL_CreateThread(live_input_worker, "live-input",
+                                       &live_engine);
+        if (!live_thread) {
+            fprintf(stderr, "Live: Eingabe-Thread fehlgeschlagen: %s\n",
+                SDL_GetError());
+            return 1;
+        }
+        printf("Live-Modus: Lese MIDI von %s...\n", live_engine.device);
+    } else if (cache_hit) {
+        /* Nichts zu tun: das PCM liegt bereits gemappt vor */
+    } else if (use_timidity) {
         memset(&env.ctx, 0, sizeof(env.ctx)); /* Sicherstellen, dass alles 0 ist */
-        generate_audio_with_timidity(midifile, &env.ctx);
+        synth_thread = generate_audio_with_timidity(midifile, duration,
+                                                    &env.ctx, &tstream);
+    } else if (prerender) {
+        synthesize_to_ram(&nl, duration, &env.ctx);
     } else {
-        synthesize_to_ram(notes, env.note_count, duration, &env.ctx);
+        synth_thread = synthesize_streaming(&nl, duration,
+                                            &env.ctx, &stream);
     }
 
 
@@ -862,14 +2788,26 @@ int main(int argc, char **argv) {
     SDL_Renderer *rend = SDL_CreateRenderer(env.win, -1,
         SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
 
+    /* Rounded-Rect-Textur für das Batched-Rendering vorbereiten */
+    rrect_tex = create_rounded_rect_texture(rend);
+    if (!rrect_tex)
+        printf("Hinweis: Keine Target-Texturen, zeichne ungebatcht.\n");
+
     SDL_AudioSpec want, have;
     memset(&want, 0, sizeof(want));
     want.freq = SAMPLE_RATE;
     want.format = AUDIO_FORMAT;
     want.channels = AUDIO_CHANNELS;
-    want.samples = 2048;
-    want.callback = audio_callback;
-    want.userdata = &env.ctx;
+    if (live) {
+        /* Kleiner Puffer für niedrige Latenz Taste-zu-Ton */
+        want.samples = LIVE_AUDIO_SAMPLES;
+        want.callback = live_audio_callback;
+        want.userdata = &live_engine;
+    } else {
+        want.samples = 2048;
+        want.callback = audio_callback;
+        want.userdata = &env.ctx;
+    }
 
     env.dev = SDL_OpenAudioDevice(NULL, 0, &want, &have, 0);
     if (env.dev == 0) {
@@ -882,35 +2820,62 @@ int main(int argc, char **argv) {
     /* 4. Main Loop */
     env.running = 1;
     env.paused = 0;
+    env.live = live;
     env.pause_start_counter = 0;
 
     /* ZEITMESSUNG: Wir nutzen den High-Res Timer für flüssige Grafik */
     env.start_counter = SDL_GetPerformanceCounter();
     env.frequency = SDL_GetPerformanceFrequency();
 
-    /* Timidity liefert manchmal etwas mehr oder weniger Audio als die
-     * MIDI Zeit berechnet. Wir nutzen die Länge des Audiobuffers als
-     * Obergrenze für den Loop. */
-    double actual_audio_duration = (double)env.ctx.total_samples / SAMPLE_RATE;
-    double loop_limit = (actual_audio_duration > duration) ? actual_audio_duration : duration;
-
     while (env.running) {
+        double f0 = now_seconds();
         handle_input(&env);
+        double f1 = now_seconds();
 
         /* Zeit berechnen */
         Uint64 current_counter = env.paused ? env.pause_start_counter : SDL_GetPerformanceCounter();
 
         double current_time = (double)(current_counter - env.start_counter) / env.frequency;
 
+        /* Die visuelle Uhr an die Audio-Uhr koppeln: läuft der
+         * Performance-Counter gegenüber der vom Callback publizierten
+         * Position um mehr als ~2 Puffer-Perioden davon (Scheduler,
+         * Drift, Synthese-Stau), den Startpunkt neu verankern. Kleine
+         * Abweichungen bleiben dem glatten Timer überlassen, sonst
+         * ruckelt das Bild im Puffertakt. Erst wenn der Ring leer ist,
+         * sonst vergleicht man gegen die Position vor einem Sprung. */
+        if (!live && !env.paused && env.ctx.total_samples > 0 &&
+            env.ctx.play_cursor < env.ctx.total_samples &&
+            transport_idle(&env.ctx)) {
+            double audio_time =
+                (double)SDL_AtomicGet(&env.ctx.pub_cursor) / SAMPLE_RATE;
+            if (fabs(current_time - audio_time) > 0.1) {
+                env.start_counter = current_counter -
+                    (Uint64)(audio_time * env.frequency);
+                current_time = audio_time;
+            }
+        }
+
+        /* Timidity liefert manchmal etwas mehr oder weniger Audio als
+         * die MIDI-Zeit berechnet. Wir nutzen die Länge des Audio-
+         * buffers als Obergrenze -- pro Frame neu gelesen, denn bis
+         * zum Pipe-Ende steht in total_samples nur die großzügige
+         * Vorallokation; die echte Länge trägt der Worker erst dann
+         * ein. */
+        double actual_audio_duration =
+            (double)env.ctx.total_samples / SAMPLE_RATE;
+        double loop_limit = (actual_audio_duration > duration)
+            ? actual_audio_duration : duration;
         double end_limit = use_timidity ? (loop_limit + 1.5) : (duration + 1.0);
 
         /* if (current_time > end_limit) env.running = 0; */
         /* Auto-Quit am Ende */
 
-        /* Wenn das Ende erreicht ist und wir nicht bereits pausiert sind: Parken */
-        if (!env.paused && current_time >= end_limit) {
+        /* Wenn das Ende erreicht ist und wir nicht bereits pausiert sind: Parken
+         * (im Live-Modus gibt es kein Ende) */
+        if (!live && !env.paused && current_time >= end_limit) {
             env.paused = 1;
-            SDL_PauseAudioDevice(env.dev, 1); /* Audio stoppen */
+            transport_send(&env.ctx, TC_PAUSE, 0); /* Audio stoppen */
 
             /*
              * Trick: Wir setzen den Zeitstempel für den Start der Pause so,
@@ -921,18 +2886,30 @@ int main(int argc, char **argv) {
 
             /* Audio-Cursor sicherheitshalber ans Ende setzen */
             if (env.ctx.total_samples > 0) {
-                env.ctx.play_cursor = env.ctx.total_samples;
+                transport_send(&env.ctx, TC_SEEK, env.ctx.total_samples);
             }
 
             /* Visuelle Zeit auf das Limit festsetzen */
             current_time = end_limit;
         }
 
+        /* Pausiert (oder am Ende geparkt) und kein Event: das Bild
+         * steht. Statt mit Vsync-Rate ein identisches Frame zu
+         * brennen, nur alle 500 ms auffrischen. */
+        if (env.paused && !env.scene_dirty &&
+            now_seconds() - env.last_draw_time < 0.5) {
+            SDL_Delay(10);
+            continue;
+        }
+
         int w, h;
         SDL_GetWindowSize(env.win, &w, &h);
         int keyboard_height = KEYBOARD_HEIGHT * w / WINDOW_WIDTH;
         int note_area_h = h - keyboard_height;
 
+        /* Geometrie-Tabelle nur bei geänderter Fensterbreite neu füllen */
+        update_key_geometry((float)w);
+
         /* BERECHNUNG: Wie viele Sekunden passen vertikal auf den Schirm? */
         /* Wir addieren einen Puffer (z.B. 1.0s), damit Noten sanft reinkommen */
         double visible_time_range = (double)note_area_h / PIXELS_PER_SECOND;
@@ -945,22 +2922,69 @@ int main(int argc, char **argv) {
         /* Tasten Status Reset */
         for(int i=0; i<128; i++) env.active_keys[i] = 0;
 
-        /* NOTEN (Falling Blocks) */
-        render_notes(rend, &env, notes, w, note_area_h, current_time, lookahead_time);
+        /* NOTEN (Falling Blocks bzw. Live-Ereignisse) */
+        if (live) {
+            live_drain_ui(&live_engine, current_time);
+            render_live_notes(rend, &env, note_area_h, current_time);
+        } else {
+            render_notes(rend, &env, &nl, note_area_h, current_time, lookahead_time);
+        }
+        double f2 = now_seconds();
 
         /* KLAVIATUR */
-        render_keyboard(rend, &env, w, note_area_h, keyboard_height);
+        render_keyboard(rend, &env, note_area_h, keyboard_height);
+        double f3 = now_seconds();
+
+        /* HUD zeigt die Werte des jeweils vorigen Frames */
+        if (env.hud_visible) hud_render(rend, &env, current_time);
         SDL_RenderPresent(rend);
+        double f4 = now_seconds();
+        env.last_draw_time = f4;
+        env.scene_dirty = 0;
+
+        env.hud_t_input = f1 - f0;
+        env.hud_t_notes = f2 - f1;   /* inkl. Clear, vernachlässigbar */
+        env.hud_t_keys = f3 - f2;
+        env.hud_t_present = f4 - f3; /* inkl. HUD selbst und VSync-Wartezeit */
+        env.hud_frame_ms[env.hud_frame_pos] = (float)((f4 - f0) * 1000.0);
+        env.hud_frame_pos = (env.hud_frame_pos + 1) % HUD_HISTORY;
     }
 
     /* Cleanup */
     SDL_CloseAudioDevice(env.dev);
+    if (synth_thread) {
+        /* Worker sauber beenden, bevor die Buffer freigegeben werden */
+        stream.abort = 1;
+        tstream.abort = 1;
+        SDL_WaitThread(synth_thread, NULL);
+    }
+    if (live_thread) {
+        live_engine.abort = 1;
+        SDL_WaitThread(live_thread, NULL);
+    }
+    if (env.kb_tex) SDL_DestroyTexture(env.kb_tex);
+    if (rrect_tex) SDL_DestroyTexture(rrect_tex);
     SDL_DestroyRenderer(rend);
     SDL_DestroyWindow(env.win);
     SDL_Quit();
-    free(env.ctx.pcm_buffer);
-    free(notes);
-    if(events) free(events);
+
+    /* Lag am Ende ein vollständig synthetisierter Song im Speicher
+     * (Prerender sofort, Streaming/Timidity nach durchgelaufenem
+     * Worker), diesen als Sidecar für den nächsten Start sichern */
+    if (!live && !cache_hit && env.ctx.total_samples > 0 &&
+        env.ctx.samples_ready >= env.ctx.total_samples) {
+        sidecar_save(midifile, sidecar_engine, &nl, duration, &env.ctx);
+    }
+
+    if (cache_hit) {
+        sidecar_unload(); /* Noten-Arrays und pcm_buffer lagen im Mapping */
+    } else {
+        free(env.ctx.pcm_buffer);
+        notelist_free(&nl);
+    }
+    mc_song_free(&song);
+    note_cache_free();
+    drum_voice_free();
 
     return 0;
 }